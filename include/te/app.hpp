@@ -10,6 +10,7 @@
 #include <te/mesh_renderer.hpp>
 #include <te/colour_picker.hpp>
 #include <te/util.hpp>
+#include <te/arena.hpp>
 #include <unordered_map>
 #include <random>
 #include <glm/glm.hpp>
@@ -17,6 +18,7 @@
 #include <te/fmod.hpp>
 #include <te/components.hpp>
 #include <te/tween.hpp>
+#include <te/fixed_step.hpp>
 #include <complex>
 #include <te/classic_ui.hpp>
 #include <ft/ft.hpp>
@@ -39,6 +41,7 @@ namespace te {
         std::optional<te::server> server;
         SteamNetworkingIPAddr server_addr;
         std::optional<te::client> client;
+        te::fixed_step sim_clock;
 
         // menu scene
         FMOD::Sound* menu_music_src;
@@ -52,13 +55,15 @@ namespace te {
         te::terrain_renderer terrain_renderer;
         te::mesh_renderer mesh_renderer;
 
+        // temporaries for drawing one frame
+        te::arena frame_arena;
         te::canvas_renderer canvas;
         te::ui::root ui;
 
         std::optional<entt::entity> inspected;
         std::optional<entt::entity> ghost;
 
-        app(te::sim& model, SteamNetworkingIPAddr server_addr);
+        app(te::sim& model, SteamNetworkingIPAddr server_addr, double tick_rate = 2.0);
 
         void on_key(int key, int scancode, int action, int mods);
         void on_mouse_button(int button, int action, int mods);
@@ -76,6 +81,9 @@ namespace te {
 
         void playsfx(std::string filename);
         void noise(std::string filename);
+        // where the coin sounds have got to in model.trade_log
+        std::uint64_t trades_heard = 0;
+        void hear_trades();
 
         void input();
         void draw();
@@ -0,0 +1,37 @@
+#ifndef TE_ARENA_HPP_INCLUDED
+#define TE_ARENA_HPP_INCLUDED
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+
+namespace te {
+    // Memory for temporaries that only last a frame, handed to std::pmr containers.
+    // Allocating bumps a pointer through one buffer and freeing does nothing; reset()
+    // frees everything at once. A frame that outgrows the buffer borrows from the heap,
+    // and the buffer is made big enough for it at the next reset, so frames like it
+    // don't touch the heap at all.
+    class arena : public std::pmr::memory_resource {
+    public:
+        explicit arena(std::size_t initial_bytes = 64 * 1024);
+        arena(const arena&) = delete;
+
+        // Everything allocated from the arena is invalid afterwards
+        void reset();
+        std::size_t capacity() const;
+
+    private:
+        std::unique_ptr<std::byte[]> buffer;
+        std::size_t buffer_bytes;
+        // asked for since the last reset, counting alignment
+        std::size_t used = 0;
+        std::optional<std::pmr::monotonic_buffer_resource> bump;
+
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+        void do_deallocate(void*, std::size_t, std::size_t) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+    };
+}
+
+#endif
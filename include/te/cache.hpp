@@ -51,6 +51,15 @@ namespace te {
             }
         }
         
+        // the entries and their names; what the assets hold, often on the GPU, isn't counted
+        std::size_t bytes() const {
+            std::size_t total = loaded.bucket_count() * sizeof(void*);
+            for (const auto& [filename, asset] : loaded) {
+                total += sizeof(std::pair<const std::string, unique_any>) + filename.capacity();
+            }
+            return total;
+        }
+
         template<typename T>
         T& lazy_load(const std::string& filename) {
             auto loaded_it = loaded.find(filename);
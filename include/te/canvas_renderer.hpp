@@ -15,6 +15,8 @@
 #include <list>
 #include <boost/signals2.hpp>
 #include <memory>
+#include <memory_resource>
+#include <te/arena.hpp>
 #include <ibus/bus.hpp>
 
 namespace te {
@@ -34,9 +36,10 @@ namespace te {
             glm::vec2 offset;
             gl::texture2d* texture;
         };
-        const std::vector<glyph_instance> glyphs;
-        const double total_width;
-        const font fnt;
+        // from the canvas's frame arena, so only good until the canvas renders
+        std::pmr::vector<glyph_instance> glyphs;
+        double total_width;
+        font fnt;
     };
 
     struct canvas_renderer {
@@ -68,6 +71,8 @@ namespace te {
         ft::face& face(font);
         std::map<font, std::unordered_map<ft::glyph_index, te::gl::texture2d>, font_comparator> glyph_textures;
         te::gl::texture2d& glyph_texture(font, ft::glyph_index);
+        // temporaries for one frame, reset once it's rendered
+        te::arena frame_arena;
 
     public:
         canvas_renderer(window&);
@@ -80,7 +85,7 @@ namespace te {
 
         // Origin is bottom-left corner for text
         text_run shape_run(std::string_view str, font fnt);
-        void run(text_run run, glm::vec2 origin);
+        void run(const text_run& run, glm::vec2 origin);
         void text(std::string_view str, glm::vec2 origin, font fnt);
 
         void render();
@@ -21,7 +21,7 @@ namespace te::ui {
         text_run run;
     };
     struct paragraph {
-        std::vector<offset_run> runs;
+        std::pmr::vector<offset_run> runs;
     };
 
     enum class position_t { static_, relative, absolute };
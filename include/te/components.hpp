@@ -1,7 +1,8 @@
 #ifndef TE_COMPONENTS_HPP_INCLUDED
 #define TE_COMPONENTS_HPP_INCLUDED
 
-#include <te/classic_ui.hpp>
+#include <string>
+#include <entt/entt.hpp>
 
 namespace te {
     // Render components
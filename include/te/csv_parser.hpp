@@ -36,7 +36,7 @@ namespace {
         }
     public:
         auto try_parse_quoted() -> std::optional<std::string> {
-            static const std::regex match_quoted_str{"\"([a-zA-Z ]*)\""};
+            static const std::regex match_quoted_str{"\"([^\"]*)\""};
             auto result = try_parse_regex(match_quoted_str);
             if (result) {
                 next_field();
@@ -0,0 +1,54 @@
+#ifndef TE_EVENT_RING_HPP_INCLUDED
+#define TE_EVENT_RING_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace te {
+    // A fixed number of the most recent events, written by one side and read by
+    // any number of others. Each reader keeps its own cursor, so reading takes
+    // nothing out for anyone else; a reader that falls more than a ring behind
+    // skips what was overwritten.
+    template<typename T>
+    class event_ring {
+    public:
+        explicit event_ring(std::size_t capacity) : slots(capacity) {
+        }
+
+        void push(const T& event) {
+            slots[written % slots.size()] = event;
+            written++;
+        }
+
+        std::size_t capacity() const {
+            return slots.size();
+        }
+
+        // the cursor of a reader that has seen everything so far
+        std::uint64_t head() const {
+            return written;
+        }
+
+        // Calls f on each event written since cursor, oldest first, and brings
+        // cursor up to date. Returns how many were overwritten before they were read.
+        template<typename F>
+        std::uint64_t drain(std::uint64_t& cursor, F&& f) const {
+            std::uint64_t missed = 0;
+            if (written - cursor > slots.size()) {
+                missed = written - slots.size() - cursor;
+                cursor = written - slots.size();
+            }
+            for (; cursor < written; cursor++) {
+                f(slots[cursor % slots.size()]);
+            }
+            return missed;
+        }
+
+    private:
+        std::vector<T> slots;
+        std::uint64_t written = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef TE_FIXED_STEP_HPP_INCLUDED
+#define TE_FIXED_STEP_HPP_INCLUDED
+
+#include <algorithm>
+
+namespace te {
+    // Accumulates wall-clock time and pays it out as whole ticks of a fixed
+    // length, so the simulation sees the same dt however fast frames are drawn.
+    struct fixed_step {
+        // seconds of simulated time per tick
+        const double step;
+        // most ticks to run per frame; any time owed beyond that is dropped
+        const int max_catch_up;
+        double accumulated = 0.0;
+
+        fixed_step(double tick_rate, int max_catch_up) : step{1.0 / tick_rate}, max_catch_up{max_catch_up} {
+        }
+
+        // Add a frame's worth of elapsed time, returning how many ticks are now due
+        int advance(double elapsed) {
+            accumulated += std::max(0.0, elapsed);
+            int due = static_cast<int>(accumulated / step);
+            if (due > max_catch_up) {
+                // we've fallen too far behind: run what we can and forget the rest
+                due = max_catch_up;
+                accumulated = 0.0;
+            } else {
+                accumulated -= due * step;
+            }
+            return due;
+        }
+
+        // How far we are between the last tick and the next, in [0, 1), for drawing in between
+        double alpha() const {
+            return std::clamp(accumulated / step, 0.0, 1.0);
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef TE_MARKET_HISTORY_HPP_INCLUDED
+#define TE_MARKET_HISTORY_HPP_INCLUDED
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace te {
+    // One commodity at one market over a span of time. Price, stock and demand
+    // are means over the span; volume is every unit traded in it.
+    struct market_sample {
+        // sim seconds at the start of the span
+        double time;
+        float price;
+        float volume;
+        float stock;
+        float demand;
+    };
+
+    // The most recent samples that fit, oldest first
+    class sample_ring {
+    public:
+        explicit sample_ring(std::size_t capacity);
+
+        void push(const market_sample& sample);
+        std::size_t size() const;
+        std::size_t capacity() const;
+        const market_sample& operator[](std::size_t ix) const;
+        // appends the samples with from <= time < to to out, oldest first
+        void between(double from, double to, std::vector<market_sample>& out) const;
+
+    private:
+        std::vector<market_sample> samples;
+        std::size_t written = 0;
+        // the first sample with time >= t, counting from the oldest
+        std::size_t lower_bound(double t) const;
+    };
+
+    enum class history_tier {
+        tick,
+        minute,
+        hour
+    };
+
+    // Samples of one commodity at one market, every tick and summed into minutes
+    // and hours. Each tier keeps a fixed number of samples, so how much memory
+    // this takes never grows however long the sim runs.
+    class commodity_history {
+    public:
+        static constexpr std::size_t tick_samples = 120;
+        static constexpr std::size_t minute_samples = 60;
+        static constexpr std::size_t hour_samples = 24;
+
+        void record(const market_sample& sample);
+        const sample_ring& tier(history_tier which) const;
+
+    private:
+        // the samples of the minute or hour not over yet
+        struct span_sum {
+            double width;
+            // which span, counting from the start of the sim, or -1 before the first sample
+            double span = -1.0;
+            double price = 0.0;
+            double volume = 0.0;
+            double stock = 0.0;
+            double demand = 0.0;
+            int count = 0;
+
+            // returns true if sample starts a new span, after writing the one it ends to closed
+            bool add(const market_sample& sample, market_sample& closed);
+        };
+
+        sample_ring ticks { tick_samples };
+        sample_ring minutes { minute_samples };
+        sample_ring hours { hour_samples };
+        span_sum this_minute { 60.0 };
+        span_sum this_hour { 3600.0 };
+    };
+
+    // Each commodity's history at one market, made the first time it's recorded
+    struct market_history {
+        std::vector<std::unique_ptr<commodity_history>> by_commodity;
+
+        void record(std::size_t commodity, const market_sample& sample);
+        // appends the samples of commodity in tier with from <= time < to to out, oldest
+        // first. The minute or hour still being summed isn't included.
+        void between(std::size_t commodity, history_tier tier, double from, double to, std::vector<market_sample>& out) const;
+    };
+}
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef TE_MEMORY_REPORT_HPP_INCLUDED
+#define TE_MEMORY_REPORT_HPP_INCLUDED
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace te {
+    struct sim;
+
+    struct component_memory {
+        std::string name;
+        std::size_t entities = 0;
+        // the storage's packed arrays of entities and components, as allocated
+        std::size_t dense_bytes = 0;
+        // strings, vectors and the like owned by the components
+        std::size_t heap_bytes = 0;
+    };
+
+    // How much memory a sim is using, and what for. Sizes are what containers have
+    // allocated rather than what they hold, and allocator overheads aren't counted.
+    struct memory_report {
+        std::vector<component_memory> components;
+        // storages in the registry that aren't measured
+        std::size_t unmeasured_storages = 0;
+        std::size_t grid_bytes = 0;
+        std::size_t routes_bytes = 0;
+        // every path still being walked, counted once however many merchants share it
+        std::size_t paths_bytes = 0;
+        // the market table and the trade log
+        std::size_t markets_bytes = 0;
+        // the entries of an asset cache, when there is one; what the assets hold isn't counted
+        std::size_t cache_bytes = 0;
+
+        std::size_t total() const;
+        void log() const;
+    };
+
+    // Walks every storage and container of model. Mustn't be called while it's ticking.
+    memory_report measure_memory(sim& model);
+}
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef TE_NET_IDS_HPP_INCLUDED
+#define TE_NET_IDS_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <entt/entt.hpp>
+
+namespace te {
+    // Hands out the ids of entities that are shared over the network. The server
+    // and each client number what they make from their own range, so one side's
+    // entities never collide with another's, and every side can use the ids as
+    // they are. An id is entt's: the low bits number the entity, the high bits
+    // are a version. A released number is reused with its version bumped, so a
+    // stale id never matches whatever took its place.
+    class net_id_allocator {
+    public:
+        // numbers below this are left for what each side makes for itself, like blueprints
+        static constexpr std::uint32_t first_shared = 4096;
+        static constexpr std::uint32_t server_range = 1u << 19;
+        static constexpr std::uint32_t client_range = 1u << 15;
+        // released numbers wait until there are this many before they're reused,
+        // so that deletions have long since reached everyone
+        static constexpr std::size_t reuse_after = 1024;
+
+        // Authority 0 is the server; clients are 1 and up
+        explicit net_id_allocator(unsigned authority = 0);
+
+        unsigned authority() const;
+        // throws std::runtime_error if every number in the range is in use
+        entt::entity allocate();
+        // ids from other authorities' ranges are ignored
+        void release(entt::entity id);
+        bool owns(entt::entity id) const;
+        std::size_t in_use() const;
+
+    private:
+        // entt's default identifiers are 20 bits of number and 12 of version
+        static constexpr std::uint32_t number_bits = 20;
+        static constexpr std::uint32_t number_mask = (1u << number_bits) - 1;
+        // the all-ones version is entt's tombstone
+        static constexpr std::uint32_t version_limit = (1u << (32 - number_bits)) - 1;
+
+        unsigned authority_ix;
+        std::uint32_t first;
+        std::uint32_t end;
+        // the lowest number never handed out
+        std::uint32_t next;
+        // the version each number will be handed out with next, from first
+        std::vector<std::uint16_t> versions;
+        // oldest first
+        std::deque<std::uint32_t> released;
+    };
+}
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef TE_OCCUPANCY_GRID_HPP_INCLUDED
+#define TE_OCCUPANCY_GRID_HPP_INCLUDED
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <random>
+#include <vector>
+#include <glm/glm.hpp>
+#include <entt/entt.hpp>
+
+namespace te {
+    // Which entity occupies each cell of the map. Cells are addressed in world
+    // coordinates, with the map centred on the origin, and stored in square
+    // chunks that are only allocated once something is built in them, so an
+    // empty stretch of map costs one null pointer per chunk. Each chunk keeps
+    // a bitset of its occupied cells alongside the entities, one word per row,
+    // so testing whether a footprint is free takes a masked word per row.
+    //
+    // For every footprint size it's asked to place, the grid also counts the
+    // free spots for it in each chunk, so it can pick one uniformly at random
+    // without guessing and retrying.
+    class occupancy_grid {
+    public:
+        // cells along each side of a chunk; one bitset word per row
+        static constexpr int chunk_side = 64;
+
+    private:
+        using word = std::uint64_t;
+
+        struct chunk {
+            std::array<entt::entity, chunk_side * chunk_side> cells;
+            std::array<word, chunk_side> occupied {};
+            // occupied cells; the chunk is freed again when this falls to zero
+            int count = 0;
+
+            chunk();
+        };
+
+        int width;
+        int height;
+        glm::ivec2 origin;
+        int chunks_across;
+        int chunks_down;
+        std::vector<std::unique_ptr<chunk>> chunks;
+
+        // Where a footprint of one size fits. A spot is counted in the chunk holding its top-left cell.
+        struct placements {
+            glm::ivec2 dimensions;
+            std::vector<int> counts;
+            // Fenwick tree over counts, for picking from the whole map in O(log chunks)
+            std::vector<int> tree;
+        };
+        std::vector<placements> indices;
+
+        // Calls f(chunk slot, top-left and bottom-right cells within the chunk) for every
+        // chunk the rectangle overlaps, stopping early if f returns false. The rectangle
+        // must be in bounds.
+        template<typename F>
+        void for_each_chunk(glm::ivec2 topleft, glm::ivec2 dimensions, F&& f) const {
+            const glm::ivec2 first = topleft - origin;
+            const glm::ivec2 last = first + dimensions - glm::ivec2{1, 1};
+            for (int cy = first.y / chunk_side; cy <= last.y / chunk_side; cy++) {
+                for (int cx = first.x / chunk_side; cx <= last.x / chunk_side; cx++) {
+                    const glm::ivec2 chunk_topleft {cx * chunk_side, cy * chunk_side};
+                    const glm::ivec2 from = glm::max(first, chunk_topleft) - chunk_topleft;
+                    const glm::ivec2 to = glm::min(last, chunk_topleft + glm::ivec2{chunk_side - 1, chunk_side - 1}) - chunk_topleft;
+                    if (!f(static_cast<std::size_t>(cy) * chunks_across + cx, from, to)) return;
+                }
+            }
+        }
+
+        // The bits of a chunk row covering columns [from, to]
+        static word row_mask(int from, int to);
+
+        // A row of a chunk's occupancy, with cells off the map counted as occupied
+        word occupied_row(int chunk_x, int chunk_y, int row) const;
+        // The cells of a chunk row where a footprint can have its top-left corner
+        word free_row(const placements& index, int chunk_x, int chunk_y, int row) const;
+        // Free spots with their top-left corner in [from, to] within a chunk
+        int count_free(const placements& index, std::size_t slot, glm::ivec2 from, glm::ivec2 to) const;
+        // As above, in rows [from_y, to_y], counting the columns mask(row) picks out of each
+        template<typename Mask>
+        int count_free(const placements& index, std::size_t slot, int from_y, int to_y, Mask&& mask) const;
+
+        placements& index_for(glm::ivec2 dimensions);
+        void set_count(placements& index, std::size_t slot, int count);
+        // The top-left cell of the nth free spot with its top-left corner in [from, to] within a chunk
+        glm::ivec2 nth_free(const placements& index, std::size_t slot, glm::ivec2 from, glm::ivec2 to, int nth) const;
+        template<typename Mask>
+        glm::ivec2 nth_free(const placements& index, std::size_t slot, int from_y, int to_y, Mask&& mask, int nth) const;
+        // Recounts the chunks holding a top-left corner whose footprint overlaps the rectangle
+        void recount(glm::ivec2 topleft, glm::ivec2 dimensions);
+
+    public:
+        occupancy_grid(int width, int height);
+
+        bool in_bounds(glm::ivec2 topleft, glm::ivec2 dimensions) const;
+        // Whether the rectangle lies on the map and none of its cells are occupied
+        bool is_free(glm::ivec2 topleft, glm::ivec2 dimensions) const;
+        // The entity in a cell, or entt::null if it's empty or off the map
+        entt::entity at(glm::ivec2 cell) const;
+
+        // Marks every cell of the rectangle as occupied by entity
+        void fill(glm::ivec2 topleft, glm::ivec2 dimensions, entt::entity entity);
+        // Empties the cells of the rectangle that are occupied by entity
+        void clear(glm::ivec2 topleft, glm::ivec2 dimensions, entt::entity entity);
+
+        // How many chunks currently hold something
+        std::size_t allocated_chunks() const;
+        // heap memory taken by chunks and placement indices
+        std::size_t bytes() const;
+
+        // A top-left cell, chosen uniformly from all those where a footprint of the
+        // given size is free and lies within the region, or nothing if there are none.
+        // Costs a lookup per chunk the region covers plus a scan of the chunks along
+        // its edges; picking from the whole map is O(log chunks) plus one chunk scan.
+        std::optional<glm::ivec2> pick_free(glm::ivec2 dimensions, glm::ivec2 region_topleft, glm::ivec2 region_dimensions, std::default_random_engine& rengine);
+        // As above, for a region of any shape with one run of top-left cells per row: row i of
+        // it is row first_row + i of the map, from column spans[i].x to spans[i].y inclusive.
+        // Circles, say, then needn't be picked from their bounding square and retried.
+        std::optional<glm::ivec2> pick_free(glm::ivec2 dimensions, int first_row, const std::vector<glm::ivec2>& spans, std::default_random_engine& rengine);
+        std::optional<glm::ivec2> pick_free(glm::ivec2 dimensions, std::default_random_engine& rengine);
+    };
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef TE_ORDER_BOOK_HPP_INCLUDED
+#define TE_ORDER_BOOK_HPP_INCLUDED
+
+#include <vector>
+#include <algorithm>
+#include <tuple>
+#include <cstddef>
+#include <entt/entt.hpp>
+
+namespace te {
+    // A standing order to buy or sell some quantity of one commodity
+    struct order {
+        entt::entity trader;
+        // lower priorities are matched first
+        std::size_t priority;
+        double quantity;
+    };
+
+    // The bids (buy orders) and asks (sell orders) for one commodity in one market
+    struct order_book {
+        std::vector<order> bids;
+        std::vector<order> asks;
+
+        void clear() {
+            bids.clear();
+            asks.clear();
+        }
+
+        void bid(entt::entity trader, std::size_t priority, double quantity) {
+            bids.push_back(order{trader, priority, quantity});
+        }
+
+        void ask(entt::entity trader, std::size_t priority, double quantity) {
+            asks.push_back(order{trader, priority, quantity});
+        }
+
+        // Sorts both sides of the book and matches them best-first. Every trade
+        // is reported as on_fill(buyer, seller, whole units moved). Ties in
+        // priority are broken by trader so the result never depends on the
+        // order in which orders were placed.
+        template<typename F>
+        void match(F&& on_fill) {
+            const auto by_priority = [](const order& lhs, const order& rhs) {
+                return std::tie(lhs.priority, lhs.trader) < std::tie(rhs.priority, rhs.trader);
+            };
+            std::sort(bids.begin(), bids.end(), by_priority);
+            std::sort(asks.begin(), asks.end(), by_priority);
+            auto bid_it = bids.begin();
+            auto ask_it = asks.begin();
+            while (bid_it != bids.end() && ask_it != asks.end()) {
+                const int movement = static_cast<int>(std::min(bid_it->quantity, ask_it->quantity));
+                if (movement > 0) {
+                    on_fill(bid_it->trader, ask_it->trader, movement);
+                    bid_it->quantity -= movement;
+                    ask_it->quantity -= movement;
+                }
+                // an order with less than one unit left can't be filled any further
+                if (bid_it->quantity < 1.0) bid_it++;
+                if (ask_it->quantity < 1.0) ask_it++;
+            }
+        }
+    };
+
+    // Per-commodity order books of a market, indexed in the same order as sim::commodities
+    struct order_books {
+        std::vector<order_book> by_commodity;
+    };
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef TE_PATHFINDING_HPP_INCLUDED
+#define TE_PATHFINDING_HPP_INCLUDED
+
+#include <te/occupancy_grid.hpp>
+#include <vector>
+#include <memory>
+#include <glm/glm.hpp>
+#include <entt/entt.hpp>
+
+namespace te {
+    // A way across the map between two points, as straight segments joining
+    // the corners of a route through free cells. Paths are shared between
+    // every merchant walking them and never change once planned; when a
+    // building is put in the way the path is marked stale instead.
+    struct path {
+        std::vector<glm::vec2> waypoints;
+        // unit direction and length of the segment leaving each waypoint
+        std::vector<glm::vec2> headings;
+        std::vector<float> lengths;
+        // the cells walked through, and the box around them
+        std::vector<glm::ivec2> cells;
+        glm::ivec2 min_cell;
+        glm::ivec2 max_cell;
+        bool stale = false;
+        // there was no way through, so this just goes straight there
+        bool straight = false;
+
+        // Whether the path walks through any cell of the rectangle
+        bool crosses(glm::ivec2 topleft, glm::ivec2 dimensions) const;
+    };
+
+    // Plans a path from one point to another with A* over the occupancy grid,
+    // moving through cells that are empty or belong to one of the two ends.
+    // If there's no way through, the path is a straight line.
+    std::shared_ptr<path> plan_path(const occupancy_grid& grid, glm::vec2 from, glm::vec2 to, entt::entity from_e, entt::entity to_e);
+}
+
+#endif
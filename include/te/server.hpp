@@ -3,47 +3,136 @@
 
 #include <te/net.hpp>
 #include <te/sim.hpp>
+#include <te/thread_pool.hpp>
+#include <te/memory_report.hpp>
 #include <unordered_map>
 #include <span>
 #include <optional>
 #include <memory>
 #include <sstream>
+#include <future>
+#include <cstdint>
+#include <utility>
+#include <vector>
 
 namespace te {
     struct client;
-    struct server {
+
+    struct session_stats {
+        std::uint64_t ticks = 0;
+        // ticks dropped because the session had fallen too far behind
+        std::uint64_t ticks_dropped = 0;
+        // wall time spent ticking, in total and per tick of the last batch
+        double tick_seconds = 0.0;
+        double last_tick_seconds = 0.0;
+        // what the session's world holds and takes up, as of the tick they were measured at
+        std::size_t entities = 0;
+        std::size_t bytes = 0;
+        std::uint64_t measured_tick = 0;
+    };
+
+    // One game: its own world and the players in it. A server runs any number of these.
+    struct session {
         struct player {
             unsigned family;
             std::string nick;
         };
 
+        const unsigned id;
+        sim model;
+        int max_players;
+        bool started = false;
+        std::unordered_map<HSteamNetConnection, std::optional<player>> net_clients;
+        // Messages from players, handled between ticks: the model can't be touched while it's ticking
+        std::vector<std::pair<HSteamNetConnection, te::msg>> inbox;
+        // simulated seconds the session is behind the server's clock, and those thrown
+        // away for being too far behind that don't yet add up to a whole tick
+        double owed = 0.0;
+        double dropped = 0.0;
+
+        // What a batch of ticks did, filled in on the pool. Only read once the batch is finished.
+        struct batch_outcome {
+            int ticks = 0;
+            double seconds = 0.0;
+            // set if the batch measured the session's memory
+            bool measured = false;
+            std::size_t entities = 0;
+            std::size_t bytes = 0;
+        };
+        // the batch running on the server's pool, if any
+        std::future<void> batch;
+        batch_outcome finished;
+        // whether what the last batch did has yet to be sent to the players and added to stats
+        bool unpublished = false;
+        session_stats stats;
+
+        session(unsigned id, int max_players, int map_width, int map_height);
+        // whether a batch is still running
+        bool ticking() const;
+    };
+
+    // Listens for players and puts each into a session, creating sessions as they're needed.
+    // Sessions tick on one shared pool, each at most one tick at a time, so a slow session
+    // falls behind on its own rather than holding up the rest.
+    struct server {
         ISteamNetworkingSockets* netio;
         HSteamListenSocket listen_sock;
         HSteamNetPollGroup poll_group;
+        int map_width;
+        int map_height;
+        // players in each new session
         int max_players = 2;
-        std::unordered_map<HSteamNetConnection, std::optional<player>> net_clients;
+        std::size_t max_sessions = 32;
+        // a session more than this many ticks behind drops the rest
+        int max_backlog = 4;
+        // ticks between measuring each session's memory for its stats
+        std::uint64_t measure_every = 600;
+        std::vector<std::unique_ptr<session>> sessions;
+        // the session each connection is in
+        std::unordered_map<HSteamNetConnection, session*> net_clients;
+        unsigned next_session_id = 0;
+        // sessions take turns at going first
+        std::size_t first_turn = 0;
+
+        session& open_session();
+        // the oldest session still waiting for players, or a new one; throws if there's no room for one
+        session& session_for_newcomer();
+        void join(HSteamNetConnection conn);
+        void leave(HSteamNetConnection conn);
 
         void recv();
-        void handle(HSteamNetConnection, te::hello);
-        void handle(HSteamNetConnection, te::chat);
-        void handle(HSteamNetConnection, te::entity_create);
-        void handle(HSteamNetConnection, te::entity_delete);
-        void handle(HSteamNetConnection, te::component_replace);
-        void handle(HSteamNetConnection, te::build);
-        sim model;
-        bool started = false;
-        void tick(double dt);
+        void handle(session&, HSteamNetConnection, te::hello);
+        void handle(session&, HSteamNetConnection, te::chat);
+        void handle(session&, HSteamNetConnection, te::entity_create);
+        void handle(session&, HSteamNetConnection, te::entity_delete);
+        void handle(session&, HSteamNetConnection, te::component_replace);
+        void handle(session&, HSteamNetConnection, te::build);
+        // start the game once everyone has said hello
+        void try_start(session&);
+        // run count ticks of the session, one after another, on the pool
+        void submit_ticks(session&, double dt, int count);
+        // send the session's players what has changed
+        void publish(session&);
+        // wait for any ticks still running, without running anything else on this thread
+        void finish_ticks();
+        // add what a finished batch did to the session's stats
+        void collect(session&);
+        // log a memory report for every session not ticking right now
+        void log_memory();
 
         void listen(std::uint16_t port);
 
         void send_bytes(HSteamNetConnection conn, std::span<const char> buffer);
-        void send_bytes_all(std::span<const char> buffer, HSteamNetConnection except = k_HSteamNetConnection_Invalid);
+        void send_bytes_all(session&, std::span<const char> buffer, HSteamNetConnection except = k_HSteamNetConnection_Invalid);
         void send(HSteamNetConnection conn, const te::msg& msg);
-        void send_all(const te::msg& msg, HSteamNetConnection except = k_HSteamNetConnection_Invalid);
+        void send_all(session&, const te::msg& msg, HSteamNetConnection except = k_HSteamNetConnection_Invalid);
 
         void OnSteamNetConnectionStatusChanged(SteamNetConnectionStatusChangedCallback_t* info);
+
+        // declared last so it's destroyed first, finishing any ticks before the sessions go
+        thread_pool workers;
     public:
-        server(ISteamNetworkingSockets* netio, std::uint16_t port);
+        server(ISteamNetworkingSockets* netio, std::uint16_t port, int map_width = 40, int map_height = 40);
         client make_local(te::sim& model);
         virtual ~server();
         void poll(double dt);
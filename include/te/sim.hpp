@@ -2,14 +2,29 @@
 #define TE_SIM_HPP_INCLUDED
 
 #include <te/util.hpp>
+#include <te/order_book.hpp>
+#include <te/thread_pool.hpp>
+#include <te/occupancy_grid.hpp>
+#include <te/pathfinding.hpp>
+#include <te/net_ids.hpp>
+#include <te/event_ring.hpp>
+#include <te/market_history.hpp>
 #include <unordered_map>
+#include <map>
+#include <deque>
+#include <memory>
 #include <vector>
 #include <random>
 #include <string>
 #include <variant>
+#include <optional>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+#include <tuple>
 #include <glm/vec2.hpp>
 #include <entt/entt.hpp>
-#include <boost/signals2.hpp>
 #include <cereal/types/unordered_map.hpp>
 #include <cereal/types/vector.hpp>
 #include <cereal/types/string.hpp>
@@ -74,6 +89,22 @@ namespace te {
         ar(x.position);
     }
 
+    // A commodity's index into sim::commodities, and into every per_commodity array
+    using commodity_slot = std::size_t;
+
+    // One value for each commodity, indexed by commodity_slot. These are always
+    // sized to sim::commodities when a component is made, so they never grow.
+    template<typename T>
+    using per_commodity = std::vector<T>;
+
+    // How a commodity is made, as listed in assets/commodities.csv
+    struct recipe {
+        // units of each commodity used up to make one
+        per_commodity<double> inputs;
+        // units made per second, or 0 where the catalogue doesn't say
+        double rate = 0.0;
+    };
+
     struct dweller {
         //TODO: programmatically represent requirements of living
         // i.e. dwellings need 2 of 3 food types in abundance
@@ -81,7 +112,7 @@ namespace te {
 
     // A demander stores the rate of increase of demand of entities
     struct demander {
-        std::unordered_map<entt::entity, double> rate;
+        per_commodity<double> rate;
     };
     template<typename Ar>
     void serialize(Ar& ar, demander& x){
@@ -94,19 +125,28 @@ namespace te {
         unsigned family_ix;
         // +ve bid = buying
         // -ve bid = selling
-        std::unordered_map<entt::entity, double> bid;
+        per_commodity<double> bid;
         double balance = 0.0;
+        // the market whose trading list this trader is on, if any; bids must be
+        // changed through sim::set_bid while it is, to keep that market's ledger right.
+        // Not replicated: replacing a trader has sim::relist_all work it out again.
+        entt::entity listed_at = entt::null;
     };
     template<typename Ar>
     void serialize(Ar& ar, trader& x){
         ar(x.family_ix, x.bid, x.balance);
     }
 
+    // when a building has nothing scheduled
+    constexpr double never = std::numeric_limits<double>::infinity();
+
     struct generator {
         bool active;
-        entt::entity output;
+        commodity_slot output;
         double rate;
         double progress = 0.0;
+        // sim time the next unit is finished, or never while there's no room to store it
+        double due = never;
     };
     template<typename Ar>
     void serialize(Ar& ar, generator& x){
@@ -114,11 +154,13 @@ namespace te {
     }
 
     struct producer {
-        std::unordered_map<entt::entity, double> inputs;
-        std::unordered_map<entt::entity, double> outputs;
+        per_commodity<double> inputs;
+        per_commodity<double> outputs;
         double rate;
         bool producing = false;
         double progress = 0.0;
+        // sim time the batch is finished or the inputs should be checked, or never while waiting for inputs
+        double due = never;
     };
     template<typename Ar>
     void serialize(Ar& ar, producer& x){
@@ -126,7 +168,7 @@ namespace te {
     }
 
     struct inventory {
-        std::unordered_map<entt::entity, int> stock;
+        per_commodity<int> stock;
     };
     template<typename Ar>
     void serialize(Ar& ar, inventory& x){
@@ -134,8 +176,9 @@ namespace te {
     }
 
     struct market {
-        std::unordered_map<entt::entity, double> prices;
-        std::unordered_map<entt::entity, double> demand;
+        // copied from sim::markets every tick, for players to see
+        per_commodity<double> prices;
+        per_commodity<double> demand;
         entt::entity commons;
         std::vector<entt::entity> trading;
         double radius = 5.0f;
@@ -148,9 +191,118 @@ namespace te {
         ar(x.prices, x.demand, x.commons, x.trading, x.radius, x.population, x.growth_rate, x.growth);
     }
 
+    // The market whose catchment an entity lies in, and where it is listed in that market's members
+    struct market_member {
+        entt::entity market;
+        std::size_t ix;
+        // only meaningful for dwellers
+        std::size_t dwelling_ix = 0;
+    };
+
+    // The entities lying in a market's catchment, and the dwellings among them
+    struct market_members {
+        std::vector<entt::entity> entities;
+        std::vector<entt::entity> dwellings;
+        // the sum of every member demander's rate
+        per_commodity<double> demand_rate;
+    };
+
+    // Every market's prices, and running totals of the bids of every trader on its
+    // trading list, kept as one row of commodities per market so that prices can be
+    // updated for every market in one pass
+    struct market_table {
+        std::size_t columns = 0;
+        // the market each row belongs to
+        std::vector<entt::entity> entities;
+        std::vector<double> prices;
+        // whole units offered for sale
+        std::vector<double> asks;
+        // units wanted, each trader's bid rounded down to the hundredth, in hundredths.
+        // These are all whole numbers, so adding and taking them away is exact.
+        std::vector<double> wanted;
+        // The commodities of each row that have ever been bid on or are demanded by a member.
+        // The rest have no bids or asks, so their prices never move and are left alone.
+        std::vector<std::vector<commodity_slot>> active;
+        std::vector<std::uint8_t> is_active;
+
+        std::size_t add_row(entt::entity market, const per_commodity<double>& market_prices) {
+            entities.push_back(market);
+            prices.insert(prices.end(), market_prices.begin(), market_prices.end());
+            asks.resize(asks.size() + columns, 0.0);
+            wanted.resize(wanted.size() + columns, 0.0);
+            active.emplace_back();
+            is_active.resize(is_active.size() + columns, 0);
+            return entities.size() - 1;
+        }
+
+        void activate(std::size_t row, commodity_slot commodity) {
+            if (!is_active[row * columns + commodity]) {
+                is_active[row * columns + commodity] = 1;
+                active[row].push_back(commodity);
+            }
+        }
+
+        // Moves the last row into row, returning the market that was moved, or null if row was the last
+        entt::entity remove_row(std::size_t row) {
+            const std::size_t last = entities.size() - 1;
+            entt::entity moved = entt::null;
+            if (row != last) {
+                moved = entities[row] = entities[last];
+                std::copy_n(prices.begin() + last * columns, columns, prices.begin() + row * columns);
+                std::copy_n(asks.begin() + last * columns, columns, asks.begin() + row * columns);
+                std::copy_n(wanted.begin() + last * columns, columns, wanted.begin() + row * columns);
+                std::copy_n(is_active.begin() + last * columns, columns, is_active.begin() + row * columns);
+                active[row] = std::move(active[last]);
+            }
+            entities.pop_back();
+            prices.resize(last * columns);
+            asks.resize(last * columns);
+            wanted.resize(last * columns);
+            is_active.resize(last * columns);
+            active.pop_back();
+            return moved;
+        }
+
+        // add (sign = 1) or take away (sign = -1) one trader's bid for a commodity
+        void post(std::size_t row, commodity_slot commodity, double bid, int sign) {
+            const std::size_t ix = row * columns + commodity;
+            if (bid != 0.0) activate(row, commodity);
+            asks[ix] += sign * std::floor(std::max(0.0, -bid));
+            wanted[ix] += sign * std::floor(std::max(0.0, bid * 100.0));
+        }
+    };
+
+    // A market's row in sim::markets
+    struct market_row {
+        std::size_t row;
+    };
+
+    // A building whose generator or producer needs attention at a certain time
+    struct production_event {
+        double due;
+        entt::entity building;
+
+        bool operator>(const production_event& rhs) const {
+            return std::tie(due, building) > std::tie(rhs.due, rhs.building);
+        }
+    };
+
+    // Marks a market waiting in sim::growing_markets, or, once it's found no room for a
+    // dwelling, one kept off the queue until retry_at
+    struct growth_queued {
+        std::optional<double> retry_at;
+    };
+
+    // The production events of a market's members, as a min-heap on due time.
+    // Events are left in place when plans change; one only counts if its due
+    // time still matches the building's.
+    struct production_schedule {
+        std::vector<production_event> events;
+    };
+
     struct stop {
         entt::entity where;
-        std::unordered_map<entt::entity, int> leave_with;
+        per_commodity<int> leave_with;
     };
     template<typename Ar>
     void serialize(Ar& ar, stop& x){
@@ -175,60 +327,241 @@ namespace te {
         ar(x.trading, x.next);
     }
 
+    enum class merchant_state {
+        // idle, with no route to follow
+        docked,
+        // walking to the next stop on its route
+        en_route,
+        // trading at a stop until it has what it should leave with
+        loading
+    };
+
     struct merchant {
         std::optional<te::route> route;
         std::size_t next_stop_ix = 0;
+        merchant_state state = merchant_state::docked;
+        // while loading, where the merchant is in its market's trading list
+        std::size_t trading_ix = 0;
+        // while en route, the path being walked and how far along it the merchant is
+        std::shared_ptr<const te::path> path;
+        std::size_t segment = 0;
+        // distance left to the end of the segment
+        float remaining = 0.0f;
+        // where it was before the last tick, so it can be drawn part way between ticks
+        glm::vec2 last_position {0.0f, 0.0f};
     };
     template<typename Ar>
     void serialize(Ar& ar, merchant& x){
-        ar(x.route, x.next_stop_ix);
+        ar(x.route, x.next_stop_ix, x.state, x.trading_ix);
     }
 
+    // How to copy one kind of component from a blueprint to the entities made from it
+    struct component_copier {
+        // make room for this many more
+        void (*reserve)(entt::registry& registry, std::size_t extra);
+        void (*copy)(entt::registry& registry, entt::entity from, entt::entity to);
+    };
+
+    // The components a blueprint's instances are made with, worked out the first time it's placed
+    struct prototype {
+        std::vector<component_copier> components;
+    };
+
+    // Seconds spent in each phase of sim::tick, summed over every tick since it was reset. The
+    // per-market phases (production, demand and trades) are summed over markets, so they add up
+    // to more than `markets` (which is wall time) when markets tick in parallel.
+    struct tick_profile {
+        double merchants = 0.0;
+        double markets = 0.0;
+        double production = 0.0;
+        double demand = 0.0;
+        double trades = 0.0;
+        double prices = 0.0;
+        double growth = 0.0;
+        double apply = 0.0;
+
+        tick_profile& operator+=(const tick_profile& rhs) {
+            merchants += rhs.merchants;
+            markets += rhs.markets;
+            production += rhs.production;
+            demand += rhs.demand;
+            trades += rhs.trades;
+            prices += rhs.prices;
+            growth += rhs.growth;
+            apply += rhs.apply;
+            return *this;
+        }
+    };
+
+    // One fill of an order: quantity units of commodity moved from seller to buyer at price each
+    struct trade_record {
+        entt::entity market;
+        entt::entity buyer;
+        entt::entity seller;
+        std::uint32_t commodity;
+        std::int32_t quantity;
+        double price;
+        std::uint64_t tick;
+    };
+
+    // What ticking one market did to the world outside of it, applied once every market has ticked
+    struct market_tick {
+        std::vector<double> family_balance;
+        std::vector<trade_record> trades;
+        tick_profile profile;
+    };
+
     struct sim {
         std::default_random_engine rengine;
 
         entt::registry entities;
         std::vector<family> families;
         std::vector<entt::entity> commodities;
+        std::unordered_map<std::string, commodity_slot> commodity_slots;
+        // throws std::invalid_argument if there's no commodity by that name
+        commodity_slot commodity_slot_of(const std::string& name) const;
+        per_commodity<double> base_prices;
+        template<typename T>
+        per_commodity<T> no_commodities() const {
+            return per_commodity<T>(commodities.size(), T{});
+        }
         std::vector<entt::entity> blueprints;
         std::vector<route> routes;
         entt::entity merchant_blueprint;
 
-        const int map_width = 40;
-        const int map_height = 40;
-        std::unordered_map<glm::ivec2, entt::entity> grid;
+        // in cells, chosen when the sim is made; the map is centred on the origin
+        const int map_width;
+        const int map_height;
+        occupancy_grid grid;
         glm::vec2 snap(glm::vec2 pos, glm::vec2 print) const;
+        // the first cell covered by a footprint centred at centre
+        static glm::ivec2 footprint_topleft(glm::vec2 centre, glm::vec2 print);
 
-        sim(unsigned seed);
+        sim(unsigned seed, int map_width = 40, int map_height = 40);
 
         void load_commodities();
         void init_blueprints();
         void generate_map();
 
+        // entities made and destroyed since the server last told clients about them
         std::vector<entt::entity> new_entities;
-        entt::entity make_net_entity(unsigned family);
-
-        // total units wanting to be sold
-        int market_stock(entt::entity market_e, entt::entity commodity_e);
-        int market_demand(entt::entity market_e, entt::entity commodity_e);
+        std::vector<entt::entity> deleted_entities;
+        net_id_allocator net_ids;
+        entt::entity make_net_entity();
+
+        // total units wanting to be sold and bought
+        int market_stock(entt::entity market_e, commodity_slot commodity);
+        int market_demand(entt::entity market_e, commodity_slot commodity);
+        // put a trader at the end of a market's trading list and its bids on the market's ledger
+        void list_trader(entt::entity market_e, entt::entity trader_e);
+        // take a trader's bids off its market's ledger; the caller takes it off the trading list
+        void unlist_trader(trader& the_trader);
+        void set_bid(trader& the_trader, commodity_slot commodity, double bid);
+        void on_trader_destroyed(entt::registry&, entt::entity trader_e);
+        // null a trader's place on a market's trading list, like a departing merchant's, so
+        // merchants further down keep their trading_ix; tick_merchants closes the gap
+        void leave_gap(entt::entity market_e, entt::entity trader_e);
+        // A trader or market replaced from outside, as replicated ones are, takes what it had
+        // posted with it, so the ledger is rebuilt from the trading lists before the next tick
+        bool ledger_stale = false;
+        void on_trader_replaced(entt::registry&, entt::entity trader_e);
+        void relist_all();
+        market_table markets;
+        void on_market_row_destroyed(entt::registry&, entt::entity market_e);
+        // a market's row in markets, added the first time it's asked for
+        std::size_t row_of(entt::entity market_e);
+        // a market replaced from outside: its prices overrule the row's
+        void on_market_replaced(entt::registry&, entt::entity market_e);
 
         market* market_at(glm::vec2 x);
         bool in_market(const site& question_site, const site& market_site, const market& the_market) const;
+        void join_market(entt::entity entity);
+        void add_member(entt::entity market_e, entt::entity member_e);
+        void on_member_destroyed(entt::registry&, entt::entity member_e);
+        void on_market_destroyed(entt::registry&, entt::entity market_e);
+        void on_demander_destroyed(entt::registry&, entt::entity demander_e);
+        // take a member demander's rate off its market's total
+        void withdraw_demand(entt::entity market_e, const demander& leaving);
+        // destroy a placed entity, freeing the cells it occupied
+        void demolish(entt::entity entity);
 
         void merchant_embark(entt::entity merchant, const route& route);
+        // The path between two markets, planned the first time a merchant needs it
+        std::shared_ptr<const path> leg(entt::entity from_market, entt::entity to_market);
+        std::map<std::pair<entt::entity, entt::entity>, std::shared_ptr<path>> legs;
+        // every path still being walked, shared legs or not, so building on one can mark it stale
+        std::vector<std::weak_ptr<path>> paths;
+        // whether any of those went straight for want of a way through
+        bool straight_paths = false;
+        void track_path(const std::shared_ptr<path>& planned);
+        void block_paths(glm::ivec2 topleft, glm::ivec2 dimensions);
+        // as above, for each (topleft, dimensions) of a batch of buildings
+        void block_paths(const std::vector<std::pair<glm::ivec2, glm::ivec2>>& footprints);
+        // mark stale every path that found no way through, now that something's been cleared away
+        void unblock_paths();
+        void set_out(merchant& the_merchant, std::shared_ptr<const path> path);
+        void merchant_arrive(entt::entity merchant_e, merchant& the_merchant);
+        void merchant_depart(entt::entity merchant_e, merchant& the_merchant);
+        // markets whose trading lists have gaps to close, left by departing merchants and destroyed traders
+        std::vector<entt::entity> vacated_markets;
         std::optional<merchant_activity> merchant_status(entt::entity merchant);
 
         bool can_place(entt::entity entity, glm::vec2 where);
-        std::optional<entt::entity> try_place(unsigned owner, entt::entity entity, glm::vec2 where);
-
+        std::optional<entt::entity> try_place(entt::entity entity, glm::vec2 where);
+        std::unordered_map<entt::entity, prototype> prototypes;
+        const prototype& prototype_of(entt::entity blueprint);
+        // make an entity from a blueprint at centre, without putting it on the map
+        entt::entity instantiate(entt::entity blueprint, const prototype& plan, glm::vec2 centre);
+        // Places a blueprint at every centre where there's room for it, returning what was
+        // placed. Storage is reserved once and paths and markets are updated once for the batch.
+        std::vector<entt::entity> spawn_many(entt::entity blueprint, const std::vector<glm::vec2>& centres);
+
+        // place proto somewhere free, returning false if there's nowhere it can go
+        bool spawn(entt::entity proto);
+        // build a dwelling on a free spot in the market's catchment, returning false if there are none
         bool spawn_dwelling(entt::entity market);
-        void spawn(entt::entity proto);
 
         void tick_merchants(double dt);
+        // seconds of simulated time since the sim started
+        double now = 0.0;
+        // how many times the sim has ticked
+        std::uint64_t ticks = 0;
+        void schedule(production_schedule& schedule, entt::entity building, double due);
+        void schedule_generator(production_schedule& schedule, entt::entity building, generator& the_generator);
+        void start_producer(production_schedule& schedule, entt::entity building);
+        // schedule a member whose stock has just changed if it was waiting on that
+        void wake(production_schedule& schedule, entt::entity building);
+        void run_production(entt::entity market_e);
+        // bring the progress of scheduled buildings up to date, for showing to players
+        void sync_progress();
+        void tick_trades(entt::entity market_e, market& market, market_tick& outcome);
+        void tick_market(entt::entity market_e, market_tick& outcome, double dt);
         void tick_markets(double dt);
+        // move every market's prices towards balancing what's wanted with what's for sale
+        void update_prices();
+        void update_growth(double dt);
+        // sample every active commodity of a market once it's ticked and its prices are up to date
+        void record_history(entt::entity market_e, const market_tick& outcome);
+        // units of each commodity traded, while a market's history is being recorded
+        per_commodity<double> traded;
+        // markets are ticked on this pool if set, otherwise one after another
+        thread_pool* pool = nullptr;
+        std::vector<entt::entity> ticking_markets;
+        std::vector<market_tick> market_ticks;
+        // tick records how long it spends in each phase while this is set
+        std::optional<tick_profile> profile;
         void tick(double delta_t, bool quiet = true);
-
-        boost::signals2::signal<void()> on_trade;
+        // markets owed whole dwellings, or due to lose some, in the order they'll be seen to
+        std::deque<entt::entity> growing_markets;
+        // the most dwellings built or demolished in one tick, across every market
+        int growth_budget = 16;
+        // seconds a market with no room for another dwelling waits before trying again
+        double growth_backoff = 10.0;
+        void apply_growth();
+
+        // Every trade, in the order markets were ticked. Read it with a cursor of your own,
+        // starting from trade_log.head(), at most once a frame.
+        event_ring<trade_record> trade_log { 1 << 14 };
     };
 }
 
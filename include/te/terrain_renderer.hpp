@@ -5,20 +5,36 @@
 #include <te/camera.hpp>
 #include <te/gl.hpp>
 #include <random>
+#include <vector>
 #include <glm/glm.hpp>
 
 namespace te {
+    // Draws the ground a chunk of tiles at a time. Every chunk shares one of a
+    // few meshes, so the memory used doesn't grow with the map, and only the
+    // chunks the camera can see are drawn.
     class terrain_renderer {
+        struct chunk_mesh {
+            int width;
+            int height;
+            int variant;
+            gl::buffer<GL_ARRAY_BUFFER> vbo;
+            GLuint vao;
+        };
+
         gl::context& gl;
-        gl::buffer<GL_ARRAY_BUFFER> vbo;
+        std::vector<chunk_mesh> meshes;
         gl::program program;
         GLint model_uniform;
         GLint view_uniform;
         GLint proj_uniform;
         gl::sampler sampler;
         gl::texture2d texture;
-        GLuint vao;
+
+        const chunk_mesh& mesh_for(int chunk_x, int chunk_y) const;
     public:
+        // different tile layouts to pick between, so that neighbouring chunks don't look the same
+        static constexpr int variants = 4;
+
         const int width;
         const int height;
         const glm::vec3 grid_topleft;
@@ -0,0 +1,94 @@
+#ifndef TE_THREAD_POOL_HPP_INCLUDED
+#define TE_THREAD_POOL_HPP_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace te {
+    // A fixed set of worker threads, each with its own queue of tasks. Workers
+    // take from the front of their own queue and, once it's empty, steal from
+    // the back of everyone else's.
+    class thread_pool {
+        struct queue {
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+        };
+        std::vector<std::unique_ptr<queue>> queues;
+        std::vector<std::thread> workers;
+        std::atomic<std::size_t> queued = 0;
+        std::atomic<std::size_t> next_queue = 0;
+        std::mutex sleep_mutex;
+        std::condition_variable wake;
+        bool stopping = false;
+
+        // Takes a task off the front of home's queue, or the back of another's. Tasks are
+        // counted in queued under the lock of the queue they're put on and uncounted
+        // under it as they're taken, so the count never falls below what's queued.
+        std::optional<std::function<void()>> take(std::size_t home);
+        void uncount();
+        void work(std::size_t home);
+
+    public:
+        explicit thread_pool(unsigned threads = std::thread::hardware_concurrency());
+        thread_pool(const thread_pool&) = delete;
+        ~thread_pool();
+
+        std::size_t size() const;
+        void submit(std::function<void()> task);
+
+        // Calls f(i) for every i in [0, n) and returns once they've all finished.
+        // The calling thread and up to one helper task per worker claim chunks of the
+        // range in turn. The caller only ever runs chunks of this loop, never anyone
+        // else's task, so it may be called from inside a task without picking up work
+        // that isn't its own; a helper that starts after the loop is done does nothing.
+        template<typename F>
+        void parallel_for(std::size_t n, F&& f) {
+            if (n == 0) return;
+            const std::size_t grain = std::max<std::size_t>(1, n / (size() * 4));
+            const std::size_t chunks = (n + grain - 1) / grain;
+            struct loop {
+                std::atomic<std::size_t> next = 0;
+                std::atomic<std::size_t> remaining;
+                std::exception_ptr failure;
+                std::mutex failure_mutex;
+            };
+            auto state = std::make_shared<loop>();
+            state->remaining = chunks;
+            // f is only touched for a chunk that's been claimed, and so isn't finished yet
+            const auto drain = [state, n, grain, chunks, &f] {
+                for (std::size_t chunk; (chunk = state->next.fetch_add(1, std::memory_order_relaxed)) < chunks;) {
+                    try {
+                        const std::size_t end = std::min(n, (chunk + 1) * grain);
+                        for (std::size_t i = chunk * grain; i < end; i++) {
+                            f(i);
+                        }
+                    } catch (...) {
+                        std::lock_guard lock { state->failure_mutex };
+                        if (!state->failure) state->failure = std::current_exception();
+                    }
+                    state->remaining.fetch_sub(1, std::memory_order_release);
+                }
+            };
+            for (std::size_t helper = 1; helper < std::min(chunks, size()); helper++) {
+                submit(drain);
+            }
+            drain();
+            while (state->remaining.load(std::memory_order_acquire) != 0) {
+                std::this_thread::yield();
+            }
+            if (state->failure) std::rethrow_exception(state->failure);
+        }
+    };
+}
+
+#endif
@@ -1,6 +1,7 @@
 #include <te/app.hpp>
 #include <te/util.hpp>
 #include <te/server.hpp>
+#include <te/memory_report.hpp>
 #include <te/client.hpp>
 #include <te/net.hpp>
 #include <te/classic_ui.hpp>
@@ -20,7 +21,7 @@ static std::string ui_img(int i) {
     return fmt::format("assets/a_ui,6.{{}}/{:0>3}.png", i);
 }
 
-te::app::app(te::sim& model, SteamNetworkingIPAddr server_addr) :
+te::app::app(te::sim& model, SteamNetworkingIPAddr server_addr, double tick_rate) :
     rengine { 42 },
     win { glfw.make_window(1024, 768, "Trade Empires", false)},
     fmod { te::make_fmod_system() },
@@ -29,6 +30,7 @@ te::app::app(te::sim& model, SteamNetworkingIPAddr server_addr) :
 
     netio { SteamNetworkingSockets() },
     server_addr { server_addr },
+    sim_clock { tick_rate, 4 },
 
     model { model },
     radius_tween {{std::polar(0.6, glm::half_pi<double>() / 2.0)}, 20},
@@ -60,10 +62,7 @@ te::app::app(te::sim& model, SteamNetworkingIPAddr server_addr) :
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    model.on_trade.connect([&]() {
-        static std::uniform_int_distribution select{1, 4};
-        playsfx(fmt::format("assets/sfx/coin{}.wav", select(rengine)));
-    });
+    trades_heard = model.trade_log.head();
 
     ui.on_click.connect([&](te::ui::node& n, int button, int action, int mods) {
         //TODO: move to global click handler
@@ -99,7 +98,8 @@ te::app::app(te::sim& model, SteamNetworkingIPAddr server_addr) :
     });
 
     // start singleplayer game
-    server.emplace(netio, te::port);
+    // the server's world has to be the same size as ours
+    server.emplace(netio, te::port, model.map_width, model.map_height);
     server->max_players = 1;
     client.emplace(server->make_local(model));
     client->send(hello{1, "SinglePringle"});
@@ -123,6 +123,12 @@ void te::app::on_key(const int key, const int scancode, const int action, const
             if (key == GLFW_KEY_H) zoom_tween.to(glm::clamp(cam.zoom_factor + 4.0f, 4.0f, 20.0f));
             if (key == GLFW_KEY_J) zoom_tween.to(glm::clamp(cam.zoom_factor - 4.0f, 4.0f, 20.0f));
         }
+        if (key == GLFW_KEY_F9 && action == GLFW_PRESS) {
+            auto report = measure_memory(model);
+            report.cache_bytes = resources.bytes();
+            report.log();
+            if (server) server->log_memory();
+        }
     }
 }
 
@@ -159,23 +165,23 @@ void te::app::render_scene() {
     const auto begin = instances.begin();
     const auto end = instances.end();
     auto it = begin;
-
-    const te::market* market = nullptr;
-    const te::site* market_site = nullptr;
-    if (inspected) {
-        market = model.entities.try_get<te::market>(*inspected);
-        market_site = model.entities.try_get<te::site>(*inspected);
-    }
+    // anything moving is drawn part of the way from where it was to where it is
+    const auto alpha = static_cast<float>(sim_clock.alpha());
 
     while (it != end) {
-        std::vector<te::mesh_renderer::instance_attributes> instance_attributes;
+        std::pmr::vector<te::mesh_renderer::instance_attributes> instance_attributes { &frame_arena };
         const auto& current_rmesh = instances.get<render_mesh>(*it);
         while (it != end && instances.get<render_mesh>(*it).filename == current_rmesh.filename) {
-            bool tinted = (market && market_site && model.in_market(instances.get<site>(*it), *market_site, *market))
+            const auto member = model.entities.try_get<te::market_member>(*it);
+            bool tinted = (inspected && member && member->market == *inspected)
                        || inspected == *it;
+            auto position = instances.get<site>(*it).position;
+            if (const auto moving = model.entities.try_get<te::merchant>(*it); moving) {
+                position = glm::mix(moving->last_position, position, alpha);
+            }
             instance_attributes.push_back (
                 te::mesh_renderer::instance_attributes {
-                    instances.get<site>(*it).position,
+                    position,
                     tinted ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f)
                 }
             );
@@ -201,6 +207,16 @@ void te::app::playsfx(std::string filename) {
     fmod->playSound(resources.lazy_load<te::fmod_sound_hnd>(filename).get(), nullptr, false, nullptr);
 }
 
+void te::app::hear_trades() {
+    bool traded = false;
+    model.trade_log.drain(trades_heard, [&](const te::trade_record&) { traded = true; });
+    // one coin a frame, however many trades there were
+    if (traded) {
+        static std::uniform_int_distribution select{1, 4};
+        playsfx(fmt::format("assets/sfx/coin{}.wav", select(rengine)));
+    }
+}
+
 void te::app::noise(std::string filename) {
     static std::string last_played = "";
     static auto last_played_at = std::chrono::system_clock::now();
@@ -286,20 +302,32 @@ double fps = 0.0;
 void te::app::run() {
     glEnable(GL_MULTISAMPLE);
     auto then = std::chrono::high_resolution_clock::now();
+    auto last_frame = then;
     int frames = 0;
     while (!glfwWindowShouldClose(win.hnd.get())) {
         input();
+        const auto frame_start = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> frame_time = frame_start - last_frame;
+        last_frame = frame_start;
+        // Each poll hands the server one step's worth of time, and it ticks the model on its
+        // pool. A model that can't keep up owes the server at most max_backlog ticks and
+        // drops the rest, as sim_clock does past max_catch_up, so under load the model falls
+        // behind the wall clock and results again depend on how fast frames are drawn.
+        for (int due = sim_clock.advance(frame_time.count()); due > 0; due--) {
+            if (server) server->poll(sim_clock.step);
+            if (client) client->poll(sim_clock.step);
+        }
+        hear_trades();
         if (frames == 30) {
             auto now = std::chrono::high_resolution_clock::now();
             std::chrono::duration<double> elapsed = now - then;
-            if (server) server->poll(elapsed.count());
-            if (client) client->poll(elapsed.count());
             fps = static_cast<double>(frames) / elapsed.count();
             spdlog::debug("fps: {}", fps);
             frames = 0;
             then = std::chrono::high_resolution_clock::now();
         }
         draw();
+        frame_arena.reset();
         glfwSwapBuffers(win.hnd.get());
         frames++;
         glfwPollEvents();
@@ -0,0 +1,35 @@
+#include <te/arena.hpp>
+#include <bit>
+
+te::arena::arena(std::size_t initial_bytes) :
+    buffer { std::make_unique_for_overwrite<std::byte[]>(initial_bytes) },
+    buffer_bytes { initial_bytes } {
+    bump.emplace(buffer.get(), buffer_bytes, std::pmr::new_delete_resource());
+}
+
+void te::arena::reset() {
+    // hands back whatever was borrowed from the heap
+    bump.reset();
+    if (used > buffer_bytes) {
+        buffer_bytes = std::bit_ceil(used);
+        buffer = std::make_unique_for_overwrite<std::byte[]>(buffer_bytes);
+    }
+    used = 0;
+    bump.emplace(buffer.get(), buffer_bytes, std::pmr::new_delete_resource());
+}
+
+std::size_t te::arena::capacity() const {
+    return buffer_bytes;
+}
+
+void* te::arena::do_allocate(std::size_t bytes, std::size_t alignment) {
+    used += bytes + alignment;
+    return bump->allocate(bytes, alignment);
+}
+
+void te::arena::do_deallocate(void*, std::size_t, std::size_t) {
+}
+
+bool te::arena::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
@@ -52,24 +52,34 @@ void te::client::handle(te::hello msg) {
     spdlog::debug("got hello from server!");
     my_family = msg.family;
     my_nick = msg.nick;
+    // anything we make ourselves gets numbered from our own range
+    model.net_ids = net_id_allocator{1 + msg.family};
 }
 void te::client::handle(te::chat msg) {
     on_chat(msg);
 }
 void te::client::handle(te::entity_create msg) {
     spdlog::debug("creating {} by servers instruction", static_cast<std::uint32_t>(msg.name));
-    model.entities.create(msg.name);
+    if (model.entities.create(msg.name) != msg.name) {
+        spdlog::error("couldn't make {}, as it's already in use", static_cast<std::uint32_t>(msg.name));
+    }
 }
 void te::client::handle(te::entity_delete msg) {
+    if (model.entities.valid(msg.name)) {
+        model.demolish(msg.name);
+    }
 }
 void te::client::handle(te::component_replace msg) {
     std::visit([&](auto& c) {
         using C = std::decay_t<decltype(c)>;
+        // entities are placed on the map when they're first given a site
+        const bool placed = std::is_same_v<C, te::site> && !model.entities.all_of<te::site>(msg.name);
         model.entities.emplace_or_replace<C>(msg.name, c);
+        if (placed) model.join_market(msg.name);
     }, msg.component);
 }
 void te::client::handle(te::build msg) {
-    model.try_place(msg.family, msg.proto, msg.where);
+    model.try_place(msg.proto, msg.where);
 }
 
 namespace {
@@ -95,6 +105,9 @@ void te::client::poll(double elapsed) {
 
     //TODO: are we gonna predict, or not?
     model.tick(elapsed);
+    // only the server tells anyone what's been made or destroyed
+    model.new_entities.clear();
+    model.deleted_entities.clear();
 }
 
 std::optional<unsigned> te::client::family() {
@@ -0,0 +1,99 @@
+#include <te/market_history.hpp>
+#include <algorithm>
+#include <cmath>
+
+te::sample_ring::sample_ring(std::size_t capacity) : samples(capacity) {
+}
+
+void te::sample_ring::push(const market_sample& sample) {
+    samples[written % samples.size()] = sample;
+    written++;
+}
+
+std::size_t te::sample_ring::size() const {
+    return std::min(written, samples.size());
+}
+
+std::size_t te::sample_ring::capacity() const {
+    return samples.size();
+}
+
+const te::market_sample& te::sample_ring::operator[](std::size_t ix) const {
+    return samples[(written - size() + ix) % samples.size()];
+}
+
+std::size_t te::sample_ring::lower_bound(double t) const {
+    // samples are pushed in time order
+    std::size_t first = 0;
+    std::size_t count = size();
+    while (count > 0) {
+        const std::size_t half = count / 2;
+        if ((*this)[first + half].time < t) {
+            first += half + 1;
+            count -= half + 1;
+        } else {
+            count = half;
+        }
+    }
+    return first;
+}
+
+void te::sample_ring::between(double from, double to, std::vector<market_sample>& out) const {
+    const std::size_t end = lower_bound(to);
+    for (std::size_t ix = lower_bound(from); ix < end; ix++) {
+        out.push_back((*this)[ix]);
+    }
+}
+
+bool te::commodity_history::span_sum::add(const market_sample& sample, market_sample& closed) {
+    const double sample_span = std::floor(sample.time / width);
+    const bool ended = count > 0 && sample_span != span;
+    if (ended) {
+        closed = market_sample {
+            span * width,
+            static_cast<float>(price / count),
+            static_cast<float>(volume),
+            static_cast<float>(stock / count),
+            static_cast<float>(demand / count)
+        };
+        price = volume = stock = demand = 0.0;
+        count = 0;
+    }
+    span = sample_span;
+    price += sample.price;
+    volume += sample.volume;
+    stock += sample.stock;
+    demand += sample.demand;
+    count++;
+    return ended;
+}
+
+void te::commodity_history::record(const market_sample& sample) {
+    ticks.push(sample);
+    market_sample closed;
+    if (this_minute.add(sample, closed)) minutes.push(closed);
+    if (this_hour.add(sample, closed)) hours.push(closed);
+}
+
+const te::sample_ring& te::commodity_history::tier(history_tier which) const {
+    switch (which) {
+        case history_tier::minute: return minutes;
+        case history_tier::hour: return hours;
+        default: return ticks;
+    }
+}
+
+void te::market_history::record(std::size_t commodity, const market_sample& sample) {
+    if (by_commodity.size() <= commodity) {
+        by_commodity.resize(commodity + 1);
+    }
+    if (!by_commodity[commodity]) {
+        by_commodity[commodity] = std::make_unique<commodity_history>();
+    }
+    by_commodity[commodity]->record(sample);
+}
+
+void te::market_history::between(std::size_t commodity, history_tier tier, double from, double to, std::vector<market_sample>& out) const {
+    if (commodity >= by_commodity.size() || !by_commodity[commodity]) return;
+    by_commodity[commodity]->tier(tier).between(from, to, out);
+}
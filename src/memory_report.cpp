@@ -0,0 +1,155 @@
+#include <te/memory_report.hpp>
+#include <te/sim.hpp>
+#include <te/components.hpp>
+#include <spdlog/spdlog.h>
+#include <memory>
+#include <optional>
+#include <type_traits>
+
+namespace {
+    template<typename T>
+    std::size_t heap_bytes(const std::vector<T>& v);
+    template<typename T>
+    std::size_t heap_bytes(const std::optional<T>& o);
+    template<typename T>
+    std::size_t heap_bytes(const std::unique_ptr<T>& p);
+
+    // plain data owns nothing; anything else needs its own overload below
+    template<typename T> requires std::is_trivially_copyable_v<T>
+    std::size_t heap_bytes(const T&) {
+        return 0;
+    }
+
+    std::size_t heap_bytes(const std::string& s) {
+        // short strings are kept inside the string itself
+        const char* inside = reinterpret_cast<const char*>(&s);
+        if (s.data() >= inside && s.data() < inside + sizeof(s)) return 0;
+        return s.capacity() + 1;
+    }
+
+    // shared with the paths every merchant walks, and counted with them
+    std::size_t heap_bytes(const std::shared_ptr<const te::path>&) {
+        return 0;
+    }
+
+    std::size_t heap_bytes(const te::path& p) {
+        return heap_bytes(p.waypoints) + heap_bytes(p.headings) + heap_bytes(p.lengths) + heap_bytes(p.cells);
+    }
+
+    std::size_t heap_bytes(const te::named& x) { return heap_bytes(x.name); }
+    std::size_t heap_bytes(const te::described& x) { return heap_bytes(x.description); }
+    std::size_t heap_bytes(const te::recipe& x) { return heap_bytes(x.inputs); }
+    std::size_t heap_bytes(const te::demander& x) { return heap_bytes(x.rate); }
+    std::size_t heap_bytes(const te::trader& x) { return heap_bytes(x.bid); }
+    std::size_t heap_bytes(const te::producer& x) { return heap_bytes(x.inputs) + heap_bytes(x.outputs); }
+    std::size_t heap_bytes(const te::inventory& x) { return heap_bytes(x.stock); }
+    std::size_t heap_bytes(const te::market& x) { return heap_bytes(x.prices) + heap_bytes(x.demand) + heap_bytes(x.trading); }
+    std::size_t heap_bytes(const te::market_members& x) { return heap_bytes(x.entities) + heap_bytes(x.dwellings) + heap_bytes(x.demand_rate); }
+    std::size_t heap_bytes(const te::production_schedule& x) { return heap_bytes(x.events); }
+    std::size_t heap_bytes(const te::order_book& x) { return heap_bytes(x.bids) + heap_bytes(x.asks); }
+    std::size_t heap_bytes(const te::order_books& x) { return heap_bytes(x.by_commodity); }
+    std::size_t heap_bytes(const te::stop& x) { return heap_bytes(x.leave_with); }
+    std::size_t heap_bytes(const te::route& x) { return heap_bytes(x.name) + heap_bytes(x.stops); }
+    std::size_t heap_bytes(const te::merchant& x) { return heap_bytes(x.route) + heap_bytes(x.path); }
+    std::size_t heap_bytes(const te::render_mesh& x) { return heap_bytes(x.filename); }
+    std::size_t heap_bytes(const te::render_tex& x) { return heap_bytes(x.filename); }
+    std::size_t heap_bytes(const te::noisy& x) { return heap_bytes(x.filename); }
+
+    std::size_t heap_bytes(const te::commodity_history& x) {
+        std::size_t total = 0;
+        for (auto tier : {te::history_tier::tick, te::history_tier::minute, te::history_tier::hour}) {
+            total += x.tier(tier).capacity() * sizeof(te::market_sample);
+        }
+        return total;
+    }
+
+    std::size_t heap_bytes(const te::market_history& x) { return heap_bytes(x.by_commodity); }
+
+    template<typename T>
+    std::size_t heap_bytes(const std::vector<T>& v) {
+        std::size_t total = v.capacity() * sizeof(T);
+        if constexpr (!std::is_trivially_copyable_v<T>) {
+            for (const auto& element : v) total += heap_bytes(element);
+        }
+        return total;
+    }
+
+    template<typename T>
+    std::size_t heap_bytes(const std::optional<T>& o) {
+        return o ? heap_bytes(*o) : 0;
+    }
+
+    template<typename T>
+    std::size_t heap_bytes(const std::unique_ptr<T>& p) {
+        return p ? sizeof(T) + heap_bytes(*p) : 0;
+    }
+
+    template<typename T>
+    void measure(entt::registry& registry, te::memory_report& report) {
+        auto& measured = report.components.emplace_back();
+        measured.name = std::string{entt::type_id<T>().name()};
+        auto& storage = registry.storage<T>();
+        measured.entities = storage.size();
+        measured.dense_bytes = storage.capacity() * (sizeof(entt::entity) + (std::is_empty_v<T> ? 0 : sizeof(T)));
+        if constexpr (!std::is_empty_v<T>) {
+            auto view = registry.view<T>();
+            for (auto e : view) {
+                measured.heap_bytes += heap_bytes(view.template get<T>(e));
+            }
+        }
+    }
+
+    template<typename... T>
+    void measure_all(entt::registry& registry, te::memory_report& report) {
+        (measure<T>(registry, report), ...);
+    }
+}
+
+std::size_t te::memory_report::total() const {
+    std::size_t sum = grid_bytes + routes_bytes + paths_bytes + markets_bytes + cache_bytes;
+    for (const auto& measured : components) {
+        sum += measured.dense_bytes + measured.heap_bytes;
+    }
+    return sum;
+}
+
+void te::memory_report::log() const {
+    for (const auto& measured : components) {
+        if (measured.entities == 0 && measured.dense_bytes == 0) continue;
+        spdlog::info("{:>40}: {:>8} entities, {:>10} bytes dense, {:>10} bytes owned",
+                     measured.name, measured.entities, measured.dense_bytes, measured.heap_bytes);
+    }
+    if (unmeasured_storages > 0) {
+        spdlog::info("{} component storage(s) not measured", unmeasured_storages);
+    }
+    spdlog::info("grid: {} bytes, routes: {} bytes, paths: {} bytes, markets: {} bytes, cache: {} bytes",
+                 grid_bytes, routes_bytes, paths_bytes, markets_bytes, cache_bytes);
+    spdlog::info("total: {} bytes", total());
+}
+
+te::memory_report te::measure_memory(sim& model) {
+    memory_report report;
+    measure_all <
+        named, described, owned, price, footprint, site, recipe, dweller, demander, trader,
+        generator, producer, inventory, market, market_member, market_members, market_row,
+        growth_queued, production_schedule, order_books, market_history, merchant,
+        render_mesh, render_tex, noisy, pickable, ghost
+    > (model.entities, report);
+    std::size_t storages = 0;
+    model.entities.visit([&](const auto) { storages++; });
+    report.unmeasured_storages = storages - report.components.size();
+
+    report.grid_bytes = model.grid.bytes();
+    report.routes_bytes = heap_bytes(model.routes);
+    report.paths_bytes = model.paths.capacity() * sizeof(model.paths[0]);
+    for (const auto& walked : model.paths) {
+        if (auto p = walked.lock(); p) report.paths_bytes += sizeof(path) + heap_bytes(*p);
+    }
+
+    const auto& markets = model.markets;
+    report.markets_bytes = markets.entities.capacity() * sizeof(entt::entity)
+        + (markets.prices.capacity() + markets.asks.capacity() + markets.wanted.capacity()) * sizeof(double)
+        + heap_bytes(markets.is_active) + heap_bytes(markets.active)
+        + model.trade_log.capacity() * sizeof(trade_record);
+    return report;
+}
@@ -0,0 +1,52 @@
+#include <te/net_ids.hpp>
+#include <fmt/format.h>
+#include <stdexcept>
+
+static_assert(sizeof(entt::entity) == sizeof(std::uint32_t), "net ids assume entt's 32 bit identifiers");
+
+te::net_id_allocator::net_id_allocator(unsigned authority) :
+    authority_ix { authority },
+    first { authority == 0 ? first_shared : first_shared + server_range + (authority - 1) * client_range },
+    end { first + (authority == 0 ? server_range : client_range) },
+    next { first } {
+    if (end - 1 > number_mask) {
+        throw std::invalid_argument{fmt::format("There's no room for entity ids for authority {}", authority)};
+    }
+}
+
+unsigned te::net_id_allocator::authority() const {
+    return authority_ix;
+}
+
+entt::entity te::net_id_allocator::allocate() {
+    std::uint32_t number;
+    if (released.size() >= reuse_after || (next == end && !released.empty())) {
+        number = released.front();
+        released.pop_front();
+    } else if (next < end) {
+        number = next++;
+        versions.push_back(0);
+    } else {
+        throw std::runtime_error{fmt::format("Authority {} has run out of entity ids", authority_ix)};
+    }
+    return entt::entity{(static_cast<std::uint32_t>(versions[number - first]) << number_bits) | number};
+}
+
+void te::net_id_allocator::release(entt::entity id) {
+    if (!owns(id)) return;
+    const std::uint32_t number = static_cast<std::uint32_t>(id) & number_mask;
+    auto& version = versions[number - first];
+    // already released
+    if (static_cast<std::uint32_t>(id) >> number_bits != version) return;
+    version = (version + 1) % version_limit;
+    released.push_back(number);
+}
+
+bool te::net_id_allocator::owns(entt::entity id) const {
+    const std::uint32_t number = static_cast<std::uint32_t>(id) & number_mask;
+    return number >= first && number < next;
+}
+
+std::size_t te::net_id_allocator::in_use() const {
+    return (next - first) - released.size();
+}
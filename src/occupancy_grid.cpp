@@ -0,0 +1,325 @@
+#include <te/occupancy_grid.hpp>
+#include <fmt/format.h>
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+te::occupancy_grid::chunk::chunk() {
+    cells.fill(entt::null);
+}
+
+te::occupancy_grid::occupancy_grid(int width, int height) :
+    width { width },
+    height { height },
+    origin { -width / 2, -height / 2 },
+    chunks_across { (width + chunk_side - 1) / chunk_side },
+    chunks_down { (height + chunk_side - 1) / chunk_side } {
+    if (width <= 0 || height <= 0) {
+        throw std::invalid_argument{fmt::format("Map must be at least one cell across, not {}x{}", width, height)};
+    }
+    chunks.resize(static_cast<std::size_t>(chunks_across) * chunks_down);
+}
+
+te::occupancy_grid::word te::occupancy_grid::row_mask(int from, int to) {
+    return (~word{0} << from) & (~word{0} >> (chunk_side - 1 - to));
+}
+
+bool te::occupancy_grid::in_bounds(glm::ivec2 topleft, glm::ivec2 dimensions) const {
+    return dimensions.x > 0 && dimensions.y > 0
+        && topleft.x >= origin.x && topleft.x + dimensions.x <= origin.x + width
+        && topleft.y >= origin.y && topleft.y + dimensions.y <= origin.y + height;
+}
+
+bool te::occupancy_grid::is_free(glm::ivec2 topleft, glm::ivec2 dimensions) const {
+    if (!in_bounds(topleft, dimensions)) return false;
+    bool free = true;
+    for_each_chunk(topleft, dimensions, [&](std::size_t slot, glm::ivec2 from, glm::ivec2 to) {
+        if (const auto& c = chunks[slot]; c) {
+            const word mask = row_mask(from.x, to.x);
+            for (int y = from.y; y <= to.y && free; y++) {
+                free = (c->occupied[y] & mask) == 0;
+            }
+        }
+        return free;
+    });
+    return free;
+}
+
+entt::entity te::occupancy_grid::at(glm::ivec2 cell) const {
+    if (!in_bounds(cell, {1, 1})) return entt::null;
+    const glm::ivec2 local = cell - origin;
+    const auto& c = chunks[static_cast<std::size_t>(local.y / chunk_side) * chunks_across + local.x / chunk_side];
+    if (!c) return entt::null;
+    return c->cells[(local.y % chunk_side) * chunk_side + local.x % chunk_side];
+}
+
+void te::occupancy_grid::fill(glm::ivec2 topleft, glm::ivec2 dimensions, entt::entity entity) {
+    if (!in_bounds(topleft, dimensions)) return;
+    for_each_chunk(topleft, dimensions, [&](std::size_t slot, glm::ivec2 from, glm::ivec2 to) {
+        auto& c = chunks[slot];
+        if (!c) c = std::make_unique<chunk>();
+        const word mask = row_mask(from.x, to.x);
+        for (int y = from.y; y <= to.y; y++) {
+            const auto row = c->cells.begin() + y * chunk_side;
+            std::fill(row + from.x, row + to.x + 1, entity);
+            c->count += std::popcount(mask & ~c->occupied[y]);
+            c->occupied[y] |= mask;
+        }
+        return true;
+    });
+    recount(topleft, dimensions);
+}
+
+void te::occupancy_grid::clear(glm::ivec2 topleft, glm::ivec2 dimensions, entt::entity entity) {
+    if (!in_bounds(topleft, dimensions)) return;
+    for_each_chunk(topleft, dimensions, [&](std::size_t slot, glm::ivec2 from, glm::ivec2 to) {
+        auto& c = chunks[slot];
+        if (!c) return true;
+        for (int y = from.y; y <= to.y; y++) {
+            for (int x = from.x; x <= to.x; x++) {
+                if (auto& cell = c->cells[y * chunk_side + x]; cell == entity) {
+                    cell = entt::null;
+                    c->occupied[y] &= ~(word{1} << x);
+                    c->count--;
+                }
+            }
+        }
+        if (c->count == 0) c.reset();
+        return true;
+    });
+    recount(topleft, dimensions);
+}
+
+std::size_t te::occupancy_grid::allocated_chunks() const {
+    return std::count_if(chunks.begin(), chunks.end(), [](const auto& c) { return c != nullptr; });
+}
+
+std::size_t te::occupancy_grid::bytes() const {
+    std::size_t total = allocated_chunks() * sizeof(chunk) + chunks.capacity() * sizeof(chunks[0]);
+    for (const auto& index : indices) {
+        total += sizeof(index) + (index.counts.capacity() + index.tree.capacity()) * sizeof(int);
+    }
+    return total;
+}
+
+te::occupancy_grid::word te::occupancy_grid::occupied_row(int chunk_x, int chunk_y, int row) const {
+    const int y = chunk_y * chunk_side + row;
+    if (chunk_x >= chunks_across || y >= height) return ~word{0};
+    word occupied = 0;
+    if (const auto& c = chunks[static_cast<std::size_t>(chunk_y) * chunks_across + chunk_x]; c) {
+        occupied = c->occupied[row];
+    }
+    if (const int on_map = width - chunk_x * chunk_side; on_map < chunk_side) {
+        occupied |= ~word{0} << on_map;
+    }
+    return occupied;
+}
+
+te::occupancy_grid::word te::occupancy_grid::free_row(const placements& index, int chunk_x, int chunk_y, int row) const {
+    word fits = ~word{0};
+    for (int dy = 0; dy < index.dimensions.y; dy++) {
+        // footprints can hang over into the chunks to the right and below
+        const int below = row + dy;
+        const int row_chunk_y = chunk_y + below / chunk_side;
+        const word here = ~occupied_row(chunk_x, row_chunk_y, below % chunk_side);
+        const word right = ~occupied_row(chunk_x + 1, row_chunk_y, below % chunk_side);
+        word run = here;
+        for (int dx = 1; dx < index.dimensions.x; dx++) {
+            run &= (here >> dx) | (right << (chunk_side - dx));
+        }
+        fits &= run;
+    }
+    return fits;
+}
+
+template<typename Mask>
+int te::occupancy_grid::count_free(const placements& index, std::size_t slot, int from_y, int to_y, Mask&& mask) const {
+    const int chunk_x = slot % chunks_across;
+    const int chunk_y = slot / chunks_across;
+    int count = 0;
+    for (int y = from_y; y <= to_y; y++) {
+        if (const word columns = mask(y); columns) {
+            count += std::popcount(free_row(index, chunk_x, chunk_y, y) & columns);
+        }
+    }
+    return count;
+}
+
+int te::occupancy_grid::count_free(const placements& index, std::size_t slot, glm::ivec2 from, glm::ivec2 to) const {
+    const word mask = row_mask(from.x, to.x);
+    return count_free(index, slot, from.y, to.y, [mask](int) { return mask; });
+}
+
+te::occupancy_grid::placements& te::occupancy_grid::index_for(glm::ivec2 dimensions) {
+    auto found = std::find_if(indices.begin(), indices.end(), [&](const placements& index) {
+        return index.dimensions == dimensions;
+    });
+    if (found != indices.end()) return *found;
+    if (dimensions.x <= 0 || dimensions.y <= 0 || dimensions.x > chunk_side || dimensions.y > chunk_side) {
+        throw std::invalid_argument{fmt::format("Can't place a {}x{} footprint", dimensions.x, dimensions.y)};
+    }
+    auto& index = indices.emplace_back(placements{dimensions, std::vector<int>(chunks.size(), 0), std::vector<int>(chunks.size() + 1, 0)});
+    for (std::size_t slot = 0; slot < chunks.size(); slot++) {
+        set_count(index, slot, count_free(index, slot, {0, 0}, {chunk_side - 1, chunk_side - 1}));
+    }
+    return index;
+}
+
+void te::occupancy_grid::set_count(placements& index, std::size_t slot, int count) {
+    const int delta = count - index.counts[slot];
+    index.counts[slot] = count;
+    for (std::size_t i = slot + 1; i < index.tree.size(); i += i & -i) {
+        index.tree[i] += delta;
+    }
+}
+
+void te::occupancy_grid::recount(glm::ivec2 topleft, glm::ivec2 dimensions) {
+    for (auto& index : indices) {
+        const glm::ivec2 from = glm::max(topleft - index.dimensions + glm::ivec2{1, 1}, origin);
+        const glm::ivec2 to = topleft + dimensions - glm::ivec2{1, 1};
+        for_each_chunk(from, to - from + glm::ivec2{1, 1}, [&](std::size_t slot, glm::ivec2, glm::ivec2) {
+            set_count(index, slot, count_free(index, slot, {0, 0}, {chunk_side - 1, chunk_side - 1}));
+            return true;
+        });
+    }
+}
+
+std::optional<glm::ivec2> te::occupancy_grid::pick_free(glm::ivec2 dimensions, glm::ivec2 region_topleft, glm::ivec2 region_dimensions, std::default_random_engine& rengine) {
+    const auto& index = index_for(dimensions);
+    // the top-left corners that keep the footprint inside both the region and the map
+    const glm::ivec2 from = glm::max(region_topleft, origin);
+    const glm::ivec2 to = glm::min(region_topleft + region_dimensions, origin + glm::ivec2{width, height}) - dimensions;
+    if (to.x < from.x || to.y < from.y) return std::nullopt;
+
+    struct candidate {
+        std::size_t slot;
+        glm::ivec2 from;
+        glm::ivec2 to;
+        int count;
+    };
+    std::vector<candidate> candidates;
+    int total = 0;
+    for_each_chunk(from, to - from + glm::ivec2{1, 1}, [&](std::size_t slot, glm::ivec2 chunk_from, glm::ivec2 chunk_to) {
+        const bool whole = chunk_from == glm::ivec2{0, 0} && chunk_to == glm::ivec2{chunk_side - 1, chunk_side - 1};
+        const int count = whole ? index.counts[slot] : count_free(index, slot, chunk_from, chunk_to);
+        if (count > 0) {
+            candidates.push_back(candidate{slot, chunk_from, chunk_to, count});
+            total += count;
+        }
+        return true;
+    });
+    if (total == 0) return std::nullopt;
+
+    int nth = std::uniform_int_distribution{0, total - 1}(rengine);
+    for (const auto& [slot, chunk_from, chunk_to, count] : candidates) {
+        if (nth < count) {
+            return nth_free(index, slot, chunk_from, chunk_to, nth);
+        }
+        nth -= count;
+    }
+    return std::nullopt;
+}
+
+std::optional<glm::ivec2> te::occupancy_grid::pick_free(glm::ivec2 dimensions, int first_row, const std::vector<glm::ivec2>& spans, std::default_random_engine& rengine) {
+    const auto& index = index_for(dimensions);
+    // the top-left corners that keep the footprint on the map
+    const glm::ivec2 last = origin + glm::ivec2{width, height} - dimensions;
+    const auto span_at = [&](int y) {
+        const auto& span = spans[y - first_row];
+        return glm::ivec2{std::max(span.x, origin.x), std::min(span.y, last.x)};
+    };
+    // the box around every span, to find the chunks to look in
+    glm::ivec2 from {last.x + 1, std::max(first_row, origin.y)};
+    glm::ivec2 to {origin.x - 1, std::min(first_row + static_cast<int>(spans.size()) - 1, last.y)};
+    for (int y = from.y; y <= to.y; y++) {
+        const auto span = span_at(y);
+        if (span.x > span.y) continue;
+        from.x = std::min(from.x, span.x);
+        to.x = std::max(to.x, span.y);
+    }
+    if (to.x < from.x || to.y < from.y) return std::nullopt;
+
+    // each chunk row's share of its map row's span
+    const auto mask_for = [&](std::size_t slot) {
+        const glm::ivec2 chunk_topleft = origin + glm::ivec2{static_cast<int>(slot % chunks_across), static_cast<int>(slot / chunks_across)} * chunk_side;
+        return [&, chunk_topleft](int row) {
+            const auto span = span_at(chunk_topleft.y + row);
+            const int first_column = std::max(span.x - chunk_topleft.x, 0);
+            const int last_column = std::min(span.y - chunk_topleft.x, chunk_side - 1);
+            return first_column <= last_column ? row_mask(first_column, last_column) : word{0};
+        };
+    };
+    struct candidate {
+        std::size_t slot;
+        int from_y;
+        int to_y;
+        int count;
+    };
+    std::vector<candidate> candidates;
+    int total = 0;
+    for_each_chunk(from, to - from + glm::ivec2{1, 1}, [&](std::size_t slot, glm::ivec2 chunk_from, glm::ivec2 chunk_to) {
+        const int count = count_free(index, slot, chunk_from.y, chunk_to.y, mask_for(slot));
+        if (count > 0) {
+            candidates.push_back(candidate{slot, chunk_from.y, chunk_to.y, count});
+            total += count;
+        }
+        return true;
+    });
+    if (total == 0) return std::nullopt;
+
+    int nth = std::uniform_int_distribution{0, total - 1}(rengine);
+    for (const auto& [slot, from_y, to_y, count] : candidates) {
+        if (nth < count) {
+            return nth_free(index, slot, from_y, to_y, mask_for(slot), nth);
+        }
+        nth -= count;
+    }
+    return std::nullopt;
+}
+
+std::optional<glm::ivec2> te::occupancy_grid::pick_free(glm::ivec2 dimensions, std::default_random_engine& rengine) {
+    const auto& index = index_for(dimensions);
+    std::size_t step = 1;
+    while (step * 2 < index.tree.size()) step *= 2;
+    const int total = [&] {
+        int sum = 0;
+        for (std::size_t i = chunks.size(); i > 0; i -= i & -i) sum += index.tree[i];
+        return sum;
+    }();
+    if (total == 0) return std::nullopt;
+
+    // descend the Fenwick tree to the chunk holding the nth free spot
+    int nth = std::uniform_int_distribution{0, total - 1}(rengine);
+    std::size_t position = 0;
+    for (; step > 0; step /= 2) {
+        if (position + step < index.tree.size() && index.tree[position + step] <= nth) {
+            position += step;
+            nth -= index.tree[position];
+        }
+    }
+    return nth_free(index, position, {0, 0}, {chunk_side - 1, chunk_side - 1}, nth);
+}
+
+glm::ivec2 te::occupancy_grid::nth_free(const placements& index, std::size_t slot, glm::ivec2 from, glm::ivec2 to, int nth) const {
+    const word mask = row_mask(from.x, to.x);
+    return nth_free(index, slot, from.y, to.y, [mask](int) { return mask; }, nth);
+}
+
+template<typename Mask>
+glm::ivec2 te::occupancy_grid::nth_free(const placements& index, std::size_t slot, int from_y, int to_y, Mask&& mask, int nth) const {
+    const int chunk_x = slot % chunks_across;
+    const int chunk_y = slot / chunks_across;
+    for (int y = from_y; y <= to_y; y++) {
+        const word columns = mask(y);
+        if (!columns) continue;
+        word fits = free_row(index, chunk_x, chunk_y, y) & columns;
+        if (const int count = std::popcount(fits); nth >= count) {
+            nth -= count;
+            continue;
+        }
+        while (nth-- > 0) fits &= fits - 1;
+        return origin + glm::ivec2{chunk_x * chunk_side + std::countr_zero(fits), chunk_y * chunk_side + y};
+    }
+    // counts and bitsets disagree, which would be a bug
+    throw std::logic_error{"occupancy_grid free space index is out of date"};
+}
@@ -0,0 +1,127 @@
+#include <te/pathfinding.hpp>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+
+namespace {
+    // give up on searches that have looked at this many cells and walk in a straight line
+    const std::size_t max_expanded = 1 << 20;
+    const float diagonal_cost = std::sqrt(2.0f);
+
+    std::uint64_t cell_key(glm::ivec2 cell) {
+        return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(cell.x)) << 32) | static_cast<std::uint32_t>(cell.y);
+    }
+
+    // the cost of the best path between two cells with nothing in the way
+    float octile(glm::ivec2 a, glm::ivec2 b) {
+        const auto dx = std::abs(a.x - b.x);
+        const auto dy = std::abs(a.y - b.y);
+        return std::max(dx, dy) + (diagonal_cost - 1.0f) * std::min(dx, dy);
+    }
+
+    std::vector<glm::ivec2> search(const te::occupancy_grid& grid, glm::ivec2 start, glm::ivec2 goal, entt::entity from_e, entt::entity to_e) {
+        const auto passable = [&](glm::ivec2 cell) {
+            if (cell == start || cell == goal) return true;
+            if (!grid.in_bounds(cell, {1, 1})) return false;
+            const auto occupant = grid.at(cell);
+            return occupant == entt::null || occupant == from_e || occupant == to_e;
+        };
+        struct visit {
+            float cost;
+            glm::ivec2 came_from;
+            bool closed = false;
+        };
+        struct frontier_entry {
+            float estimate;
+            glm::ivec2 cell;
+            bool operator>(const frontier_entry& rhs) const { return estimate > rhs.estimate; }
+        };
+        std::unordered_map<std::uint64_t, visit> visited;
+        std::priority_queue<frontier_entry, std::vector<frontier_entry>, std::greater<>> frontier;
+        visited[cell_key(start)] = visit{0.0f, start};
+        frontier.push({octile(start, goal), start});
+
+        while (!frontier.empty() && visited.size() < max_expanded) {
+            const auto [estimate, cell] = frontier.top();
+            frontier.pop();
+            auto& here = visited[cell_key(cell)];
+            if (here.closed) continue;
+            here.closed = true;
+            if (cell == goal) {
+                std::vector<glm::ivec2> cells { goal };
+                while (cells.back() != start) {
+                    cells.push_back(visited[cell_key(cells.back())].came_from);
+                }
+                std::reverse(cells.begin(), cells.end());
+                return cells;
+            }
+            const float cost = here.cost;
+            for (int dx = -1; dx <= 1; dx++) {
+                for (int dy = -1; dy <= 1; dy++) {
+                    if (dx == 0 && dy == 0) continue;
+                    const glm::ivec2 next = cell + glm::ivec2{dx, dy};
+                    if (!passable(next)) continue;
+                    // don't cut the corners of buildings
+                    if (dx != 0 && dy != 0 && !(passable(cell + glm::ivec2{dx, 0}) && passable(cell + glm::ivec2{0, dy}))) continue;
+                    const float next_cost = cost + (dx != 0 && dy != 0 ? diagonal_cost : 1.0f);
+                    auto [it, inserted] = visited.try_emplace(cell_key(next), visit{next_cost, cell});
+                    if (!inserted) {
+                        if (it->second.closed || it->second.cost <= next_cost) continue;
+                        it->second = visit{next_cost, cell};
+                    }
+                    frontier.push({next_cost + octile(next, goal), next});
+                }
+            }
+        }
+        return {};
+    }
+}
+
+bool te::path::crosses(glm::ivec2 topleft, glm::ivec2 dimensions) const {
+    const glm::ivec2 bottomright = topleft + dimensions - glm::ivec2{1, 1};
+    if (bottomright.x < min_cell.x || bottomright.y < min_cell.y || topleft.x > max_cell.x || topleft.y > max_cell.y) {
+        return false;
+    }
+    return std::any_of(cells.begin(), cells.end(), [&](glm::ivec2 cell) {
+        return cell.x >= topleft.x && cell.y >= topleft.y && cell.x <= bottomright.x && cell.y <= bottomright.y;
+    });
+}
+
+std::shared_ptr<te::path> te::plan_path(const occupancy_grid& grid, glm::vec2 from, glm::vec2 to, entt::entity from_e, entt::entity to_e) {
+    auto planned = std::make_shared<path>();
+    const glm::ivec2 start {glm::floor(from)};
+    const glm::ivec2 goal {glm::floor(to)};
+    planned->cells = search(grid, start, goal, from_e, to_e);
+    planned->waypoints.push_back(from);
+    if (planned->cells.empty()) {
+        spdlog::debug("No path from ({}, {}) to ({}, {}), going straight", from.x, from.y, to.x, to.y);
+        planned->cells = { start, goal };
+        planned->straight = true;
+    } else {
+        // only keep the cells where the path turns
+        for (std::size_t i = 1; i + 1 < planned->cells.size(); i++) {
+            const auto& cells = planned->cells;
+            if (cells[i] - cells[i - 1] != cells[i + 1] - cells[i]) {
+                planned->waypoints.push_back(glm::vec2{cells[i]} + glm::vec2{0.5f, 0.5f});
+            }
+        }
+    }
+    planned->waypoints.push_back(to);
+
+    for (std::size_t i = 0; i + 1 < planned->waypoints.size(); i++) {
+        const glm::vec2 course = planned->waypoints[i + 1] - planned->waypoints[i];
+        const float length = glm::length(course);
+        planned->lengths.push_back(length);
+        planned->headings.push_back(length > 0.0f ? course / length : glm::vec2{0.0f, 0.0f});
+    }
+    planned->min_cell = planned->max_cell = planned->cells.front();
+    for (const auto& cell : planned->cells) {
+        planned->min_cell = glm::min(planned->min_cell, cell);
+        planned->max_cell = glm::max(planned->max_cell, cell);
+    }
+    return planned;
+}
@@ -2,16 +2,30 @@
 #include <te/app.hpp>
 #include <spdlog/spdlog.h>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
 #include <sstream>
 #include <cereal/types/map.hpp>
 #include <cereal/types/vector.hpp>
 #include <cereal/types/string.hpp>
 #include <cereal/archives/binary.hpp>
 
-te::server::server(ISteamNetworkingSockets* netio, std::uint16_t port) :
-    netio { netio },
+te::session::session(unsigned id, int max_players, int map_width, int map_height) :
+    id { id },
     //TODO: figure seed shit out
-    model { 44 } {
+    model { 44, map_width, map_height },
+    max_players { max_players } {
+}
+
+bool te::session::ticking() const {
+    return batch.valid() && batch.wait_for(std::chrono::seconds{0}) != std::future_status::ready;
+}
+
+te::server::server(ISteamNetworkingSockets* netio, std::uint16_t port, int map_width, int map_height) :
+    netio { netio },
+    map_width { map_width },
+    map_height { map_height } {
     listen(port);
 }
 
@@ -19,6 +33,7 @@ te::server::~server() {
     if (listen_sock != k_HSteamListenSocket_Invalid) {
         shutdown();
     }
+    finish_ticks();
 }
 
 void te::server::listen(std::uint16_t port) {
@@ -38,10 +53,12 @@ void te::server::listen(std::uint16_t port) {
 
 void te::server::shutdown() {
     spdlog::info("Closing connections...");
-    for (auto [conn, client] : net_clients) {
+    for (auto [conn, joined] : net_clients) {
         netio->CloseConnection(conn, 0, "Server Shutdown", true /* linger */);
     }
     net_clients.clear();
+    finish_ticks();
+    sessions.clear();
 
     netio->CloseListenSocket(listen_sock);
     listen_sock = k_HSteamListenSocket_Invalid;
@@ -54,8 +71,8 @@ void te::server::send_bytes(HSteamNetConnection conn, std::span<const char> buff
     netio->SendMessageToConnection(conn, buffer.data(), buffer.size(), k_nSteamNetworkingSend_Reliable, nullptr);
 }
 
-void te::server::send_bytes_all(std::span<const char> buffer, HSteamNetConnection except) {
-    for (auto [conn, client] : net_clients) {
+void te::server::send_bytes_all(session& s, std::span<const char> buffer, HSteamNetConnection except) {
+    for (auto [conn, client] : s.net_clients) {
         if (conn != except) {
             send_bytes(conn, buffer);
         }
@@ -68,45 +85,77 @@ void te::server::send(HSteamNetConnection conn, const te::msg& msg) {
     send_bytes(conn, as_char_span);
 }
 
-void te::server::send_all(const te::msg& msg, HSteamNetConnection except) {
-    for (auto [conn, client] : net_clients) {
-        if (conn != except) {
-            send(conn, msg);
+void te::server::send_all(session& s, const te::msg& msg, HSteamNetConnection except) {
+    // serialize once for everyone
+    std::string as_str = serialized(msg);
+    send_bytes_all(s, std::span<const char>{as_str.cbegin(), as_str.cend()}, except);
+}
+
+void te::server::run() {
+}
+
+te::session& te::server::open_session() {
+    if (sessions.size() >= max_sessions) {
+        throw std::runtime_error{fmt::format("There's no room for more than {} sessions", max_sessions)};
+    }
+    auto& opened = *sessions.emplace_back(std::make_unique<session>(next_session_id++, max_players, map_width, map_height));
+    opened.model.pool = &workers;
+    spdlog::info("Opened session {}", opened.id);
+    return opened;
+}
+
+te::session& te::server::session_for_newcomer() {
+    for (auto& s : sessions) {
+        if (!s->started && static_cast<int>(s->net_clients.size()) < s->max_players) {
+            return *s;
         }
     }
+    return open_session();
 }
 
-void te::server::run() {
+void te::server::join(HSteamNetConnection conn) {
+    auto& joined = session_for_newcomer();
+    joined.net_clients.emplace(conn, std::nullopt);
+    net_clients.emplace(conn, &joined);
+    spdlog::debug("Connection {} joined session {}", conn, joined.id);
+}
+
+void te::server::leave(HSteamNetConnection conn) {
+    auto joined_it = net_clients.find(conn);
+    if (joined_it == net_clients.end()) return;
+    joined_it->second->net_clients.erase(conn);
+    net_clients.erase(joined_it);
 }
 
-void te::server::handle(HSteamNetConnection conn, te::hello msg) {
+void te::server::handle(session& s, HSteamNetConnection conn, te::hello msg) {
     spdlog::debug("hello: family {}, {}", msg.family, msg.nick);
     netio->SetConnectionName(conn, msg.nick.c_str());
-    auto player_it = net_clients.find(conn);
+    auto player_it = s.net_clients.find(conn);
+    if (player_it == s.net_clients.end()) return;
     if (!player_it->second) {
         player_it->second.emplace(msg.family, msg.nick);
     } else {
         spdlog::error("client <{}, {}> trying to hello twice", player_it->second->nick, player_it->second->family);
     }
 }
-void te::server::handle(HSteamNetConnection conn, te::chat msg) {
-    send_all(msg);
+void te::server::handle(session& s, HSteamNetConnection conn, te::chat msg) {
+    send_all(s, msg);
 }
-void te::server::handle(HSteamNetConnection conn, te::entity_create msg) {
-    model.entities.create(msg.name);
-    send_all(msg);
+void te::server::handle(session& s, HSteamNetConnection conn, te::entity_create msg) {
+    s.model.entities.create(msg.name);
+    send_all(s, msg);
 }
-void te::server::handle(HSteamNetConnection conn, te::entity_delete) {
+void te::server::handle(session& s, HSteamNetConnection conn, te::entity_delete) {
 }
-void te::server::handle(HSteamNetConnection conn, te::component_replace msg) {
+void te::server::handle(session& s, HSteamNetConnection conn, te::component_replace msg) {
     std::visit([&](auto& c) {
         using C = std::decay_t<decltype(c)>;
-        model.entities.emplace_or_replace<C>(msg.name, c);
+        s.model.entities.emplace_or_replace<C>(msg.name, c);
     }, msg.component);
-    send_all(msg);
+    send_all(s, msg);
 }
-void te::server::handle(HSteamNetConnection conn, te::build msg) {
-    model.try_place(msg.family, msg.proto, msg.where);
+void te::server::handle(session& s, HSteamNetConnection conn, te::build msg) {
+    s.model.try_place(msg.proto, msg.where);
     //send_all(msg);
 }
 
@@ -122,7 +171,7 @@ te::client te::server::make_local(te::sim& model) {
     if (!netio->SetConnectionPollGroup(server_end, poll_group)) {
         spdlog::error("error setting poll group");
     }
-    net_clients.emplace(server_end, std::nullopt);
+    join(server_end);
     return te::client{netio, client_end, model};
 }
 
@@ -135,10 +184,9 @@ void te::server::recv() {
             static_cast<const char*>(received->m_pData),
             static_cast<std::size_t>(received->m_cbSize)
         };
-        auto received_msg = te::deserialized<te::msg>(payload);
-        std::visit([&](auto& m) {
-            handle(received->m_conn, m);
-        }, received_msg);
+        if (auto joined_it = net_clients.find(received->m_conn); joined_it != net_clients.end()) {
+            joined_it->second->inbox.emplace_back(received->m_conn, te::deserialized<te::msg>(payload));
+        }
         count_received = netio->ReceiveMessagesOnPollGroup(poll_group, &incoming, 1);
     }
     if (count_received < 0) {
@@ -149,84 +197,196 @@ void te::server::recv() {
 void te::server::poll(double dt) {
     netio->RunCallbacks();
     recv();
-    tick(dt);
 
+    // Sessions still busy with their last ticks are skipped and run what they owe once
+    // they're free, so one slow world never holds up the rest. A session owing more
+    // than max_backlog ticks drops the rest. Whoever goes first changes each poll.
+    const std::size_t count = sessions.size();
+    for (std::size_t turn = 0; turn < count; turn++) {
+        auto& s = *sessions[(first_turn + turn) % count];
+        if (s.started) {
+            s.owed += dt;
+            if (s.owed > max_backlog * dt) {
+                s.dropped += s.owed - max_backlog * dt;
+                s.owed = max_backlog * dt;
+                const double whole = std::floor(s.dropped / dt);
+                s.stats.ticks_dropped += static_cast<std::uint64_t>(whole);
+                s.dropped -= whole * dt;
+            }
+        }
+        if (s.ticking()) continue;
+        if (s.unpublished) {
+            collect(s);
+            publish(s);
+            s.unpublished = false;
+        }
+        for (auto& [conn, msg] : s.inbox) {
+            std::visit([&](auto& m) {
+                handle(s, conn, m);
+            }, msg);
+        }
+        s.inbox.clear();
+        try_start(s);
+        if (s.started && s.owed >= dt) {
+            const int count = static_cast<int>(s.owed / dt);
+            s.owed -= count * dt;
+            submit_ticks(s, dt, count);
+        }
+    }
+    first_turn = count > 0 ? (first_turn + 1) % count : 0;
+
+    // sessions everyone has left are closed once they're idle
+    std::erase_if(sessions, [](const auto& s) {
+        if (s->net_clients.empty() && !s->ticking()) {
+            spdlog::info("Closing session {}", s->id);
+            return true;
+        }
+        return false;
+    });
+}
+
+void te::server::submit_ticks(session& s, double dt, int count) {
+    // walking every storage is too slow to do each tick
+    const bool measure = s.stats.ticks + count >= s.stats.measured_tick + measure_every;
+    // the promise outlives the session if it's closed the moment the batch is done
+    auto done = std::make_shared<std::promise<void>>();
+    s.batch = done->get_future();
+    workers.submit([&s, dt, count, measure, done] {
+        const auto start = std::chrono::steady_clock::now();
+        try {
+            for (int i = 0; i < count; i++) {
+                s.model.tick(dt);
+            }
+        } catch (const std::exception& e) {
+            spdlog::error("Session {} failed to tick: {}", s.id, e.what());
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        s.finished = session::batch_outcome{count, elapsed.count()};
+        if (measure) {
+            s.finished.measured = true;
+            s.finished.entities = s.model.entities.alive();
+            s.finished.bytes = measure_memory(s.model).total();
+        }
+        s.unpublished = true;
+        done->set_value();
+    });
+}
+
+void te::server::collect(session& s) {
+    const auto& finished = s.finished;
+    if (finished.ticks == 0) return;
+    s.stats.ticks += finished.ticks;
+    s.stats.last_tick_seconds = finished.seconds / finished.ticks;
+    s.stats.tick_seconds += finished.seconds;
+    if (finished.measured) {
+        s.stats.entities = finished.entities;
+        s.stats.bytes = finished.bytes;
+        s.stats.measured_tick = s.stats.ticks;
+    }
+    s.finished = {};
+}
+
+void te::server::log_memory() {
+    for (auto& s : sessions) {
+        if (s->ticking()) continue;
+        spdlog::info("Session {}:", s->id);
+        measure_memory(s->model).log();
+    }
+}
+
+void te::server::finish_ticks() {
+    for (auto& s : sessions) {
+        if (s->batch.valid()) s->batch.wait();
+    }
+    for (auto& s : sessions) {
+        if (s->unpublished) collect(*s);
+    }
+}
+
+void te::server::publish(session& s) {
+    auto& model = s.model;
+    // deletions go first, in case an id has been reused this tick
+    for (auto e : model.deleted_entities) {
+        send_all(s, entity_delete{e});
+    }
+    model.deleted_entities.clear();
     for (auto e : model.new_entities) {
-        send_all(entity_create{e});
+        send_all(s, entity_create{e});
     }
     model.new_entities.clear();
+    model.sync_progress();
     {
         auto v = model.entities.view<te::generator>();
-        for (auto e : v) send_all(component_replace{e, v.get<te::generator>(e)});
+        for (auto e : v) send_all(s, component_replace{e, v.get<te::generator>(e)});
     }
     {
         auto v = model.entities.view<te::trader>();
-        for (auto e : v) send_all(component_replace{e, v.get<te::trader>(e)});
+        for (auto e : v) send_all(s, component_replace{e, v.get<te::trader>(e)});
     }
     {
         auto v = model.entities.view<te::inventory>();
-        for (auto e : v) send_all(component_replace{e, v.get<te::inventory>(e)});
+        for (auto e : v) send_all(s, component_replace{e, v.get<te::inventory>(e)});
     }
     {
         auto v = model.entities.view<te::producer>();
-        for (auto e : v) send_all(component_replace{e, v.get<te::producer>(e)});
+        for (auto e : v) send_all(s, component_replace{e, v.get<te::producer>(e)});
     }
     {
         auto v = model.entities.view<te::market>();
-        for (auto e : v) send_all(component_replace{e, v.get<te::market>(e)});
+        for (auto e : v) send_all(s, component_replace{e, v.get<te::market>(e)});
     }
     {
         auto v = model.entities.view<te::site>();
-        for (auto e : v) send_all(component_replace{e, v.get<te::site>(e)});
+        for (auto e : v) send_all(s, component_replace{e, v.get<te::site>(e)});
     }
     {
         auto v = model.entities.view<te::render_mesh>();
-        for (auto e : v) send_all(component_replace{e, v.get<te::render_mesh>(e)});
+        for (auto e : v) send_all(s, component_replace{e, v.get<te::render_mesh>(e)});
     }
     {
         auto v = model.entities.view<te::render_tex>();
-        for (auto e : v) send_all(component_replace{e, v.get<te::render_tex>(e)});
+        for (auto e : v) send_all(s, component_replace{e, v.get<te::render_tex>(e)});
     }
     {
         auto v = model.entities.view<te::noisy>();
-        for (auto e : v) send_all(component_replace{e, v.get<te::noisy>(e)});
+        for (auto e : v) send_all(s, component_replace{e, v.get<te::noisy>(e)});
     }
     {
         auto v = model.entities.view<te::pickable>();
-        for (auto e : v) send_all(component_replace{e, v.get<te::pickable>(e)});
+        for (auto e : v) send_all(s, component_replace{e, v.get<te::pickable>(e)});
     }
     {
         auto v = model.entities.view<te::site>();
-        for (auto e : v) send_all(component_replace{e, v.get<te::site>(e)});
+        for (auto e : v) send_all(s, component_replace{e, v.get<te::site>(e)});
     }
     {
         auto v = model.entities.view<te::footprint>();
-        for (auto e : v) send_all(component_replace{e, v.get<te::footprint>(e)});
+        for (auto e : v) send_all(s, component_replace{e, v.get<te::footprint>(e)});
     }
     {
         auto v = model.entities.view<te::named>();
-        for (auto e : v) send_all(component_replace{e, v.get<te::named>(e)});
+        for (auto e : v) send_all(s, component_replace{e, v.get<te::named>(e)});
     }
     {
         auto v = model.entities.view<te::described>();
-        for (auto e : v) send_all(component_replace{e, v.get<te::described>(e)});
+        for (auto e : v) send_all(s, component_replace{e, v.get<te::described>(e)});
     }
 }
 
-void te::server::tick(double dt) {
+void te::server::try_start(session& s) {
     int players_hellod = std::count_if (
-        net_clients.begin(),
-        net_clients.end(),
+        s.net_clients.begin(),
+        s.net_clients.end(),
         [](auto& pair) {
             auto& [conn, player] = pair;
             return player.has_value();
         }
     );
 
-    if (players_hellod == max_players && !started) {
-        started = true;
-        spdlog::debug("We have {} players. Starting game with:", players_hellod);
-        for (auto [conn, player] : net_clients) {
+    if (players_hellod == s.max_players && !s.started) {
+        s.started = true;
+        spdlog::debug("Session {} has {} players. Starting game with:", s.id, players_hellod);
+        for (auto [conn, player] : s.net_clients) {
             if (player) {
                 spdlog::debug("*  {} as family {}", player->nick, player->family);
                 send(conn, te::hello{player->family, player->nick});
@@ -234,6 +394,7 @@ void te::server::tick(double dt) {
                 spdlog::debug("*  <spectator>");
             }
         }
+        auto& model = s.model;
         model.generate_map();
 
         auto named_es = model.entities.view<te::named>();
@@ -244,10 +405,6 @@ void te::server::tick(double dt) {
             }
         }
     }
-
-    if (started) {
-        model.tick(dt);
-    }
 }
 
 void te::server::OnSteamNetConnectionStatusChanged(SteamNetConnectionStatusChangedCallback_t* info) {
@@ -268,8 +425,7 @@ void te::server::OnSteamNetConnectionStatusChanged(SteamNetConnectionStatusChang
             // Locate the client.  Note that it should have been found, because this
             // is the only codepath where we remove clients (except on shutdown),
             // and connection change callbacks are dispatched in queue order.
-            auto client_it = net_clients.find(info->m_hConn);
-            assert(client_it != net_clients.end());
+            assert(net_clients.find(info->m_hConn) != net_clients.end());
 
             // Select appropriate log messages
             const char* close_reason;
@@ -285,7 +441,7 @@ void te::server::OnSteamNetConnectionStatusChanged(SteamNetConnectionStatusChang
                 info->m_info.m_eEndReason,
                 info->m_info.m_szEndDebug
             );
-            net_clients.erase(client_it);
+            leave(info->m_hConn);
         } else {
             assert(info->m_eOldState == k_ESteamNetworkingConnectionState_Connecting);
         }
@@ -306,7 +462,12 @@ void te::server::OnSteamNetConnectionStatusChanged(SteamNetConnectionStatusChang
             spdlog::info("Failed to set poll group?");
             break;
         }
-        net_clients.emplace(info->m_hConn, std::nullopt);
+        try {
+            join(info->m_hConn);
+        } catch (const std::runtime_error& e) {
+            netio->CloseConnection(info->m_hConn, 0, e.what(), false);
+            spdlog::info("Turned away {}: {}", info->m_info.m_szConnectionDescription, e.what());
+        }
         break;
     }
     case k_ESteamNetworkingConnectionState_Connected:
@@ -1,6 +1,6 @@
 #include <te/sim.hpp>
 #include <te/csv_parser.hpp>
-#include <te/app.hpp>
+#include <te/components.hpp>
 #include <spdlog/spdlog.h>
 #include <fstream>
 #include <regex>
@@ -9,9 +9,62 @@
 #include <cstdlib>
 #include <optional>
 #include <utility>
+#include <chrono>
+#include <unordered_map>
 
-te::sim::sim(unsigned int seed) : rengine { seed } {
+namespace {
+    template<typename T>
+    void reserve_more(entt::registry& registry, std::size_t extra) {
+        registry.reserve<T>(registry.size<T>() + extra);
+    }
+
+    template<typename T>
+    void copy_component(entt::registry& registry, entt::entity from, entt::entity to) {
+        if constexpr (std::is_empty_v<T>) {
+            registry.emplace<T>(to);
+        } else {
+            registry.emplace<T>(to, registry.get<T>(from));
+        }
+    }
+
+    // instances are named after their blueprint, and numbered
+    void copy_name(entt::registry& registry, entt::entity from, entt::entity to) {
+        registry.emplace<te::named>(to, fmt::format("{} (#{})", registry.get<te::named>(from).name, static_cast<unsigned>(to)));
+    }
+
+    template<typename T>
+    te::component_copier copier() {
+        return {&reserve_more<T>, &copy_component<T>};
+    }
+
+    template<>
+    te::component_copier copier<te::named>() {
+        return {&reserve_more<te::named>, &copy_name};
+    }
+
+    // Adds a copier for each of T the blueprint has, returning how many it added
+    template<typename... T>
+    std::size_t plan_copies(entt::registry& registry, entt::entity blueprint, std::vector<te::component_copier>& copiers) {
+        const std::size_t before = copiers.size();
+        ((registry.all_of<T>(blueprint) ? copiers.push_back(copier<T>()) : void()), ...);
+        return copiers.size() - before;
+    }
+}
+
+te::sim::sim(unsigned int seed, int map_width, int map_height) :
+    rengine { seed },
+    map_width { map_width },
+    map_height { map_height },
+    grid { map_width, map_height } {
+    entities.on_destroy<market_member>().connect<&sim::on_member_destroyed>(*this);
+    entities.on_destroy<market_members>().connect<&sim::on_market_destroyed>(*this);
+    entities.on_destroy<demander>().connect<&sim::on_demander_destroyed>(*this);
+    entities.on_destroy<trader>().connect<&sim::on_trader_destroyed>(*this);
+    entities.on_destroy<market_row>().connect<&sim::on_market_row_destroyed>(*this);
+    entities.on_update<market>().connect<&sim::on_market_replaced>(*this);
+    entities.on_update<trader>().connect<&sim::on_trader_replaced>(*this);
     load_commodities();
+    markets.columns = commodities.size();
     init_blueprints();
 }
 
@@ -20,50 +73,79 @@ void te::sim::generate_map() {
     for (int i = 0; i < 40; i++) spawn(blueprints[select_blueprint(rengine)]);
 }
 
-entt::entity te::sim::make_net_entity(unsigned family) {
-    static int counter = 2000 + 2000 * family;
-    auto created = entities.create(entt::entity { ++counter });
+entt::entity te::sim::make_net_entity() {
+    const auto id = net_ids.allocate();
+    auto created = entities.create(id);
+    if (created != id) {
+        spdlog::error("Entity {} was already taken, so made {} instead", static_cast<std::uint32_t>(id), static_cast<std::uint32_t>(created));
+    }
     new_entities.push_back(created);
     return created;
 }
 
 void te::sim::load_commodities() {
-    static const std::vector<std::string> only_see {
-        "Barley", "Carnelian", "Flax", "Furniture", "Linen cloth", "Wood"
-    };
     std::ifstream fstr("assets/commodities.csv");
+    if (!fstr) {
+        throw std::runtime_error("Couldn't open assets/commodities.csv");
+    }
     std::string line;
     // skip header
     std::getline(fstr, line);
+    // recipes name their inputs, which may come later in the file
+    std::vector<std::string> inputs;
+    std::vector<double> rates;
     while (std::getline(fstr, line)) {
         csv_parser csv {line.cbegin(), line.cend()};
         auto name = csv.parse_quoted();
-        auto find_name = std::find(only_see.begin(), only_see.end(), name);
-        if (find_name != only_see.end()) {
-            auto entity = commodities.emplace_back(entities.create());
-            entities.emplace<named>(entity, name);
-            entities.emplace<price>(entity, csv.parse_double());
-            entities.emplace<render_tex>(entity, fmt::format("assets/commodities/icons/{}.png", name));
+        const double base_price = csv.parse_double();
+        // produced at
+        csv.try_parse_quoted();
+        rates.push_back(csv.try_parse_double().value_or(0.0));
+        inputs.push_back(csv.try_parse_quoted().value_or("None"));
+
+        commodity_slots.emplace(name, commodities.size());
+        auto entity = commodities.emplace_back(entities.create());
+        entities.emplace<named>(entity, name);
+        entities.emplace<price>(entity, base_prices.emplace_back(base_price));
+        entities.emplace<render_tex>(entity, fmt::format("assets/commodities/icons/{}.png", name));
+    }
+
+    // inputs look like "4 Copper, 1 Zinc"
+    static const std::regex input_amount {"([0-9.]+) +([^,]*[^, ])"};
+    for (commodity_slot made = 0; made < commodities.size(); made++) {
+        auto& made_recipe = entities.emplace<recipe>(commodities[made], no_commodities<double>(), rates[made]);
+        for (auto it = std::sregex_iterator(inputs[made].begin(), inputs[made].end(), input_amount); it != std::sregex_iterator(); it++) {
+            const auto input_name = (*it)[2].str();
+            if (auto input = commodity_slots.find(input_name); input != commodity_slots.end()) {
+                made_recipe.inputs[input->second] += std::stod((*it)[1].str());
+            } else {
+                spdlog::warn("{} is made from {}, which isn't a commodity", entities.get<named>(commodities[made]).name, input_name);
+            }
         }
     }
 }
 
-void te::sim::init_blueprints() {
-    families.resize(3);
-    // Commodities
-    std::unordered_map<entt::entity, double> base_market_prices;
-    for (auto e : commodities) {
-        base_market_prices[e] = entities.get<price>(e).price;
+te::commodity_slot te::sim::commodity_slot_of(const std::string& name) const {
+    if (auto found = commodity_slots.find(name); found != commodity_slots.end()) {
+        return found->second;
     }
+    throw std::invalid_argument(fmt::format("No commodity is called {}", name));
+}
 
+void te::sim::init_blueprints() {
+    const auto barley = commodity_slot_of("Barley");
+    const auto flax = commodity_slot_of("Flax");
+    const auto furniture = commodity_slot_of("Furniture");
+    const auto linen = commodity_slot_of("Linen cloth");
+    families.resize(3);
     // Buildings
     auto barley_field = blueprints.emplace_back(entities.create());
     entities.emplace<named>(barley_field, "Barley Field");
     entities.emplace<described>(barley_field, "Barley fields produce a commodity demanded by dwellings. Supplying barley will allow the population at a market to increase.");
     entities.emplace<footprint>(barley_field, glm::vec2{2.0f,2.0f});
-    entities.emplace<generator>(barley_field, false, commodities[0], 1.0 / 14.0);
-    entities.emplace<inventory>(barley_field);
-    entities.emplace<trader>(barley_field, 0u);
+    entities.emplace<generator>(barley_field, false, barley, 1.0 / 14.0);
+    entities.emplace<inventory>(barley_field, no_commodities<int>());
+    entities.emplace<trader>(barley_field, 0u, no_commodities<double>());
     entities.emplace<render_mesh>(barley_field, "assets/barley.glb");
     entities.emplace<pickable>(barley_field);
 
@@ -71,19 +153,19 @@ void te::sim::init_blueprints() {
     entities.emplace<named>(flax_field, "Flax Field");
     entities.emplace<described>(flax_field, "Flax fields produce a commodity demanded by dwellings. Supplying barley will allow the population at a market to increase.");
     entities.emplace<footprint>(flax_field, glm::vec2{2.0f,2.0f});
-    entities.emplace<generator>(flax_field, false, commodities[2], 1.0 / 10.0);
-    entities.emplace<inventory>(flax_field);
-    entities.emplace<trader>(flax_field, 0u);
+    entities.emplace<generator>(flax_field, false, flax, 1.0 / 10.0);
+    entities.emplace<inventory>(flax_field, no_commodities<int>());
+    entities.emplace<trader>(flax_field, 0u, no_commodities<double>());
     entities.emplace<render_mesh>(flax_field, "assets/wheat.glb");
     entities.emplace<pickable>(flax_field);
 
     auto dwelling = blueprints.emplace_back(entities.create());
     entities.emplace<named>(dwelling, "Dwelling");
     entities.emplace<footprint>(dwelling, glm::vec2{1.0f,1.0f});
-    demander& dwelling_demander = entities.emplace<demander>(dwelling);
-    dwelling_demander.rate[commodities[0]] = 1.0 / (2*60.0 + 45.0); // it takes 2m45s to demand 1x wheat
-    dwelling_demander.rate[commodities[3]] = 1.0 / (9*60.0);
-    dwelling_demander.rate[commodities[4]] = 1.0 / (10*60.0);
+    demander& dwelling_demander = entities.emplace<demander>(dwelling, no_commodities<double>());
+    dwelling_demander.rate[barley] = 1.0 / (2*60.0 + 45.0); // it takes 2m45s to demand 1x wheat
+    dwelling_demander.rate[furniture] = 1.0 / (9*60.0);
+    dwelling_demander.rate[linen] = 1.0 / (10*60.0);
     entities.emplace<dweller>(dwelling);
     entities.emplace<render_mesh>(dwelling, "assets/dwelling.glb");
     entities.emplace<pickable>(dwelling);
@@ -92,7 +174,7 @@ void te::sim::init_blueprints() {
     entities.emplace<named>(market, "Trading Post");
     entities.emplace<price>(market, 200.0);
     entities.emplace<footprint>(market, glm::vec2{2.0f,2.0f});
-    entities.emplace<te::market>(market, base_market_prices);
+    entities.emplace<te::market>(market, base_prices, no_commodities<double>());
     entities.emplace<render_mesh>(market, "assets/market.glb");
     entities.emplace<noisy>(market, "assets/sfx/market2.wav");
     entities.emplace<pickable>(market);
@@ -100,13 +182,12 @@ void te::sim::init_blueprints() {
     auto weaver = blueprints.emplace_back(entities.create());
     entities.emplace<named>(weaver, "Weaver");
     entities.emplace<footprint>(weaver, glm::vec2{1.0f, 1.0f});
-    std::unordered_map<entt::entity, double> inputs;
-    inputs[commodities[2]] = 3.0;
-    std::unordered_map<entt::entity, double> outputs;
-    outputs[commodities[4]] = 1.0;
-    entities.emplace<inventory>(weaver);
-    entities.emplace<producer>(weaver, inputs, outputs, 1.0 / 12.0);
-    entities.emplace<trader>(weaver, 0u);
+    const auto& weaving = entities.get<recipe>(commodities[linen]);
+    auto outputs = no_commodities<double>();
+    outputs[linen] = 1.0;
+    entities.emplace<inventory>(weaver, no_commodities<int>());
+    entities.emplace<producer>(weaver, weaving.inputs, outputs, weaving.rate);
+    entities.emplace<trader>(weaver, 0u, no_commodities<double>());
     entities.emplace<price>(weaver, 1000.0);
     entities.emplace<render_mesh>(weaver, "assets/mill.glb");
     entities.emplace<pickable>(weaver);
@@ -134,24 +215,117 @@ bool te::sim::in_market(const site& question_site, const site& market_site, cons
     return glm::length(glm::vec2{question_site.position - market_site.position}) <= the_market.radius;
 }
 
-bool te::sim::can_place(entt::entity entity, glm::vec2 centre) {
-    {
-        const auto& print = entities.get<footprint>(entity);
-        const glm::vec2 topleft = centre - print.dimensions / 2.0f;
-        for (int x = 0; x < print.dimensions.x; x++) {
-            for (int y = 0; y < print.dimensions.y; y++) {
-                if (
-                    grid.find({topleft.x + x, topleft.y + y}) != grid.end()
-                    || centre.x + x >  map_width / 2
-                    || centre.x + x < -map_width / 2
-                    || centre.y + y >  map_height / 2
-                    || centre.y + y < -map_height / 2
-                ) {
-                    return false;
-                }
+void te::sim::join_market(entt::entity e) {
+    if (entities.any_of<market_member, merchant>(e)) return;
+    if (auto the_market = entities.try_get<te::market>(e); the_market) {
+        const auto& market_site = entities.get<site>(e);
+        for (auto other_e : entities.view<site>()) {
+            if (other_e == e || entities.any_of<te::market, merchant, market_member>(other_e)) continue;
+            if (in_market(entities.get<site>(other_e), market_site, *the_market)) {
+                add_member(e, other_e);
+            }
+        }
+    } else if (auto the_site = entities.try_get<site>(e); the_site) {
+        auto markets = entities.view<te::market, site>();
+        for (auto market_e : markets) {
+            if (in_market(*the_site, markets.get<site>(market_e), markets.get<te::market>(market_e))) {
+                add_member(market_e, e);
+                break;
             }
         }
     }
+}
+
+void te::sim::add_member(entt::entity market_e, entt::entity member_e) {
+    auto& members = entities.get_or_emplace<market_members>(market_e);
+    auto& member = entities.emplace<market_member>(member_e, market_e, members.entities.size());
+    members.entities.push_back(member_e);
+    if (entities.all_of<dweller>(member_e)) {
+        member.dwelling_ix = members.dwellings.size();
+        members.dwellings.push_back(member_e);
+        entities.get<te::market>(market_e).population++;
+    }
+    if (auto the_demander = entities.try_get<demander>(member_e); the_demander) {
+        auto& total = members.demand_rate;
+        total.resize(commodities.size(), 0.0);
+        const auto row = row_of(market_e);
+        for (commodity_slot commodity = 0; commodity < the_demander->rate.size(); commodity++) {
+            total[commodity] += the_demander->rate[commodity];
+            if (the_demander->rate[commodity] != 0.0) markets.activate(row, commodity);
+        }
+    }
+    auto& schedule = entities.get_or_emplace<production_schedule>(market_e);
+    if (auto the_generator = entities.try_get<generator>(member_e); the_generator) {
+        the_generator->active = true;
+        schedule_generator(schedule, member_e, *the_generator);
+    }
+    if (auto the_producer = entities.try_get<producer>(member_e); the_producer) {
+        the_producer->due = now;
+        this->schedule(schedule, member_e, now);
+    }
+}
+
+void te::sim::on_member_destroyed(entt::registry&, entt::entity member_e) {
+    const auto [market_e, ix, dwelling_ix] = entities.get<market_member>(member_e);
+    auto members = entities.try_get<market_members>(market_e);
+    if (members && ix < members->entities.size() && members->entities[ix] == member_e) {
+        members->entities[ix] = members->entities.back();
+        entities.get<market_member>(members->entities[ix]).ix = ix;
+        members->entities.pop_back();
+    }
+    auto the_market = entities.try_get<te::market>(market_e);
+    if (members && dwelling_ix < members->dwellings.size() && members->dwellings[dwelling_ix] == member_e) {
+        members->dwellings[dwelling_ix] = members->dwellings.back();
+        entities.get<market_member>(members->dwellings[dwelling_ix]).dwelling_ix = dwelling_ix;
+        members->dwellings.pop_back();
+        if (the_market) the_market->population--;
+    }
+    leave_gap(market_e, member_e);
+    if (auto the_trader = entities.try_get<trader>(member_e); the_trader) {
+        unlist_trader(*the_trader);
+    }
+    if (auto the_generator = entities.try_get<generator>(member_e); the_generator) {
+        the_generator->active = false;
+    }
+    // whichever of market_member and demander goes first takes the demand off the total
+    if (auto the_demander = entities.try_get<demander>(member_e); the_demander) {
+        withdraw_demand(market_e, *the_demander);
+    }
+}
+
+void te::sim::on_demander_destroyed(entt::registry&, entt::entity demander_e) {
+    if (auto member = entities.try_get<market_member>(demander_e); member) {
+        withdraw_demand(member->market, entities.get<demander>(demander_e));
+    }
+}
+
+void te::sim::withdraw_demand(entt::entity market_e, const demander& leaving) {
+    auto members = entities.try_get<market_members>(market_e);
+    if (!members || members->demand_rate.empty()) return;
+    for (commodity_slot commodity = 0; commodity < leaving.rate.size(); commodity++) {
+        members->demand_rate[commodity] -= leaving.rate[commodity];
+    }
+}
+
+void te::sim::on_market_destroyed(entt::registry&, entt::entity market_e) {
+    auto orphaned = std::move(entities.get<market_members>(market_e).entities);
+    entities.get<market_members>(market_e).entities.clear();
+    entities.get<market_members>(market_e).dwellings.clear();
+    for (auto member_e : orphaned) {
+        entities.remove<market_member>(member_e);
+    }
+    std::erase_if(legs, [&](auto& leg) {
+        if (leg.first.first != market_e && leg.first.second != market_e) return false;
+        leg.second->stale = true;
+        return true;
+    });
+}
+
+bool te::sim::can_place(entt::entity entity, glm::vec2 centre) {
+    const auto& print = entities.get<footprint>(entity);
+    if (!grid.is_free(footprint_topleft(centre, print.dimensions), glm::ivec2{print.dimensions})) {
+        return false;
+    }
     if (auto maybe_market = entities.try_get<market>(entity); maybe_market) {
         auto other_markets = entities.view<site, market>();
         const bool conflict = std::any_of (
@@ -168,365 +342,888 @@ bool te::sim::can_place(entt::entity entity, glm::vec2 centre) {
     return true;
 }
 
-std::optional<entt::entity> te::sim::try_place(unsigned owner, entt::entity proto, glm::vec2 centre) {
+std::optional<entt::entity> te::sim::try_place(entt::entity proto, glm::vec2 centre) {
     if (!can_place(proto, centre)) {
         return {};
     }
 
-    auto instantiated = make_net_entity(owner);
-    entities.emplace<site>(instantiated, centre);
-    if (auto c = entities.try_get<named>(proto)) entities.emplace<named>(instantiated, fmt::format("{} (#{})", c->name, static_cast<unsigned>(instantiated)));
-    if (auto c = entities.try_get<described>(proto)) entities.emplace<described>(instantiated, *c);
-    if (auto c = entities.try_get<footprint>(proto)) entities.emplace<footprint>(instantiated, *c);
-    if (auto c = entities.try_get<demander>(proto)) entities.emplace<demander>(instantiated, *c);
-    if (auto c = entities.try_get<trader>(proto)) entities.emplace<trader>(instantiated, *c);
-    if (auto c = entities.try_get<generator>(proto)) entities.emplace<generator>(instantiated, *c);
-    if (auto c = entities.try_get<producer>(proto)) entities.emplace<producer>(instantiated, *c);
-    if (auto c = entities.try_get<market>(proto)) entities.emplace<market>(instantiated, *c);
-    if (auto c = entities.try_get<inventory>(proto)) entities.emplace<inventory>(instantiated, *c);
-    //TODO: Move non-sim related stuff out
-    if (auto c = entities.try_get<render_mesh>(proto)) entities.emplace<render_mesh>(instantiated, *c);
-    if (auto c = entities.try_get<pickable>(proto)) entities.emplace<pickable>(instantiated, *c);
-    if (auto c = entities.try_get<noisy>(proto)) entities.emplace<noisy>(instantiated, *c);
+    auto instantiated = instantiate(proto, prototype_of(proto), centre);
 
-    auto& print = entities.get<footprint>(instantiated);
-    glm::vec2 topleft = centre - print.dimensions / 2.0f;
-    for (int x = 0; x < print.dimensions.x; x++) {
-        for (int y = 0; y < print.dimensions.y; y++) {
-            grid[{topleft.x + x, topleft.y + y}] = instantiated;
-        }
+    const auto& print = entities.get<footprint>(instantiated);
+    grid.fill(footprint_topleft(centre, print.dimensions), glm::ivec2{print.dimensions}, instantiated);
+    block_paths(footprint_topleft(centre, print.dimensions), glm::ivec2{print.dimensions});
+
+    // a new market needs its row before anything joins it
+    if (entities.all_of<te::market>(instantiated)) {
+        row_of(instantiated);
     }
+    join_market(instantiated);
 
     //TODO: somehow get rid of this special casing
     if (auto market = entities.try_get<te::market>(instantiated); market) {
-        auto commons = make_net_entity(owner);
-        entities.emplace<trader>(commons, 0u);
+        auto commons = make_net_entity();
+        entities.emplace<trader>(commons, 0u, no_commodities<double>());
         entities.emplace<named>(commons, fmt::format("Commons (#{})", static_cast<unsigned>(commons)));
-        entities.emplace<inventory>(commons);
+        entities.emplace<inventory>(commons, no_commodities<int>());
         market->commons = commons;
-        market->trading.push_back(commons);
+        list_trader(instantiated, commons);
         // make things trade
-        auto traders = entities.view<site, trader>();
-        for (auto trader_e : traders) {
-            if (!entities.try_get<te::merchant>(trader_e) && in_market(entities.get<site>(trader_e), {centre}, *market)) {
-                market->trading.push_back(trader_e);
+        for (auto member_e : entities.get_or_emplace<market_members>(instantiated).entities) {
+            if (entities.all_of<te::trader>(member_e)) {
+                list_trader(instantiated, member_e);
             }
         }
-    } else if (auto trader = entities.try_get<te::trader>(instantiated); trader) {
-        auto markets = entities.view<te::site, te::market>();
-        for (auto market_e : markets) {
-            auto& market = markets.get<te::market>(market_e);
-            if (in_market({centre}, markets.get<site>(market_e), market)) {
-                market.trading.push_back(instantiated);
-                break;
+    } else if (auto member = entities.try_get<market_member>(instantiated); member && entities.all_of<te::trader>(instantiated)) {
+        list_trader(member->market, instantiated);
+    }
+    return instantiated;
+}
+
+const te::prototype& te::sim::prototype_of(entt::entity blueprint) {
+    if (auto found = prototypes.find(blueprint); found != prototypes.end()) {
+        return found->second;
+    }
+    auto& plan = prototypes[blueprint];
+    //TODO: Move non-sim related stuff out
+    // dweller has to come along too, or placed dwellings don't count towards their market's population
+    const std::size_t copied = plan_copies <
+        named, described, footprint, demander, dweller, trader, generator, producer, market, inventory,
+        render_mesh, pickable, noisy
+    > (entities, blueprint, plan.components);
+    std::size_t components = 0;
+    entities.visit(blueprint, [&](const auto) { components++; });
+    // what a blueprint costs to build isn't passed on to what's built
+    const std::size_t uncopied = components - copied - (entities.all_of<price>(blueprint) ? 1 : 0);
+    if (uncopied > 0) {
+        const auto name = entities.all_of<named>(blueprint) ? entities.get<named>(blueprint).name : "A blueprint";
+        spdlog::warn("{} has {} component(s) that won't be copied to what's built from it", name, uncopied);
+    }
+    return plan;
+}
+
+entt::entity te::sim::instantiate(entt::entity blueprint, const prototype& plan, glm::vec2 centre) {
+    auto instantiated = make_net_entity();
+    entities.emplace<site>(instantiated, centre);
+    for (const auto& component : plan.components) {
+        component.copy(entities, blueprint, instantiated);
+    }
+    return instantiated;
+}
+
+std::vector<entt::entity> te::sim::spawn_many(entt::entity blueprint, const std::vector<glm::vec2>& centres) {
+    std::vector<entt::entity> placed;
+    // markets are few, and each needs its commons and catchment set up
+    if (entities.all_of<market>(blueprint)) {
+        for (auto centre : centres) {
+            if (auto instantiated = try_place(blueprint, centre); instantiated) {
+                placed.push_back(*instantiated);
             }
         }
+        return placed;
+    }
+
+    const auto& plan = prototype_of(blueprint);
+    const glm::ivec2 dimensions {entities.get<footprint>(blueprint).dimensions};
+    for (const auto& component : plan.components) {
+        component.reserve(entities, centres.size());
+    }
+    entities.reserve<site>(entities.size<site>() + centres.size());
+    new_entities.reserve(new_entities.size() + centres.size());
+    placed.reserve(centres.size());
+    std::vector<std::pair<glm::ivec2, glm::ivec2>> footprints;
+    footprints.reserve(centres.size());
+    for (auto centre : centres) {
+        const auto topleft = footprint_topleft(centre, glm::vec2{dimensions});
+        if (!grid.is_free(topleft, dimensions)) continue;
+        const auto instantiated = instantiate(blueprint, plan, centre);
+        grid.fill(topleft, dimensions, instantiated);
+        footprints.emplace_back(topleft, dimensions);
+        placed.push_back(instantiated);
+    }
+    block_paths(footprints);
+
+    // Markets' catchments never overlap, so at most one market takes each building. Bucket
+    // the markets by position so each building only checks the few near it.
+    struct catchment {
+        entt::entity market;
+        glm::vec2 centre;
+        double radius;
+    };
+    double bucket_side = 1.0;
+    std::vector<catchment> catchments;
+    auto market_view = entities.view<market, site>();
+    for (auto market_e : market_view) {
+        const auto radius = market_view.get<market>(market_e).radius;
+        catchments.push_back(catchment{market_e, market_view.get<site>(market_e).position, radius});
+        bucket_side = std::max(bucket_side, radius);
+    }
+    const auto bucket_of = [&](glm::vec2 position) {
+        return glm::ivec2{glm::floor(position / static_cast<float>(bucket_side))};
+    };
+    const auto bucket_key = [](glm::ivec2 bucket) {
+        return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(bucket.x)) << 32) | static_cast<std::uint32_t>(bucket.y);
+    };
+    std::unordered_map<std::uint64_t, std::vector<std::size_t>> buckets;
+    for (std::size_t ix = 0; ix < catchments.size(); ix++) {
+        buckets[bucket_key(bucket_of(catchments[ix].centre))].push_back(ix);
+    }
+    const bool trades = entities.all_of<trader>(blueprint);
+    for (auto instantiated : placed) {
+        const auto& placed_site = entities.get<site>(instantiated);
+        const auto home = bucket_of(placed_site.position);
+        std::optional<entt::entity> joined;
+        for (int dx = -1; dx <= 1 && !joined; dx++) {
+            for (int dy = -1; dy <= 1 && !joined; dy++) {
+                auto bucket = buckets.find(bucket_key(home + glm::ivec2{dx, dy}));
+                if (bucket == buckets.end()) continue;
+                for (auto ix : bucket->second) {
+                    const auto& nearby = catchments[ix];
+                    if (glm::length(placed_site.position - nearby.centre) <= nearby.radius) {
+                        joined = nearby.market;
+                        break;
+                    }
+                }
+            }
+        }
+        if (joined) {
+            add_member(*joined, instantiated);
+            if (trades) list_trader(*joined, instantiated);
+        }
+    }
+    return placed;
+}
+
+void te::sim::demolish(entt::entity entity) {
+    auto the_site = entities.try_get<site>(entity);
+    auto print = entities.try_get<footprint>(entity);
+    if (the_site && print) {
+        grid.clear(footprint_topleft(the_site->position, print->dimensions), glm::ivec2{print->dimensions}, entity);
+        unblock_paths();
+    }
+    entities.destroy(entity);
+    net_ids.release(entity);
+    // clients that were never told about it needn't hear it's gone
+    if (auto fresh = std::find(new_entities.begin(), new_entities.end(), entity); fresh != new_entities.end()) {
+        new_entities.erase(fresh);
+    } else {
+        deleted_entities.push_back(entity);
     }
-    return instantiated;
 }
 
 glm::vec2 te::sim::snap(glm::vec2 pos, glm::vec2 print) const {
     return round(pos - print / 2.0f) + print / 2.0f;
 }
 
-void te::sim::spawn(entt::entity proto) {
+glm::ivec2 te::sim::footprint_topleft(glm::vec2 centre, glm::vec2 print) {
+    return glm::ivec2{round(centre - print / 2.0f)};
+}
+
+bool te::sim::spawn(entt::entity proto) {
     const auto print = entities.get<footprint>(proto);
-    const double min_x = -map_width / 2.0;
-    std::uniform_real_distribution select_x_pos {min_x, min_x + map_width};
-    const double min_y = -map_height / 2.0;
-    std::uniform_real_distribution select_y_pos {min_y, min_y + map_height};
-try_again:
-    const glm::vec2 topleft {
-        std::round(select_x_pos(rengine)),
-        std::round(select_y_pos(rengine))
-    };
-    const glm::vec2 centre = topleft + print.dimensions / 2.0f;
-    if (!try_place(0, proto, centre))
-        goto try_again;
+    // the grid only knows about free cells, so a market might still land too near another
+    for (int attempts = 0; attempts < 16; attempts++) {
+        const auto topleft = grid.pick_free(glm::ivec2{print.dimensions}, rengine);
+        if (!topleft) break;
+        if (try_place(proto, glm::vec2{*topleft} + print.dimensions / 2.0f)) return true;
+    }
+    spdlog::warn("Nowhere left to spawn {}", static_cast<unsigned>(proto));
+    return false;
 }
 
 bool te::sim::spawn_dwelling(entt::entity market_e) {
-    const auto& [market_site, market] = entities.get<site, te::market>(market_e);
-    std::uniform_real_distribution select_x_pos {
-        market_site.position.x - market.radius,
-        market_site.position.x + market.radius
-    };
-    std::uniform_real_distribution select_y_pos {
-        market_site.position.y - market.radius,
-        market_site.position.y + market.radius
-    };
+    // copies, since placing a dwelling can move components around
+    const auto market_site = entities.get<site>(market_e);
+    const auto market = entities.get<te::market>(market_e);
     //TODO: un-hardcode this
     auto dwelling_blueprint = blueprints[2];
-    int attempts = 0;
-try_again:
-    const glm::vec2 topleft {
-        std::round(select_x_pos(rengine)),
-        std::round(select_y_pos(rengine))
-    };
-    const glm::vec2 centre = topleft + glm::vec2{1.0f, 1.0f} / 2.0f;
-    if (!try_place(0, dwelling_blueprint, centre)) {
-        if (attempts++ >= 5) {
-            return false;
-        } else {
-            goto try_again;
+    const auto print = entities.get<footprint>(dwelling_blueprint);
+    // For each row of top-left cells across the catchment, the run of them that puts a
+    // dwelling's centre inside it, so any free spot picked is one that can be built on
+    const auto centre_of = [&](int x, int y) { return glm::vec2{x, y} + print.dimensions / 2.0f; };
+    const auto inside = [&](int x, int y) { return in_market(site{centre_of(x, y)}, market_site, market); };
+    const int first_row = static_cast<int>(std::floor(market_site.position.y - market.radius - print.dimensions.y / 2.0f)) - 1;
+    const int last_row = static_cast<int>(std::ceil(market_site.position.y + market.radius - print.dimensions.y / 2.0f)) + 1;
+    std::vector<glm::ivec2> spans;
+    spans.reserve(last_row - first_row + 1);
+    for (int y = first_row; y <= last_row; y++) {
+        const double dy = centre_of(0, y).y - market_site.position.y;
+        if (std::abs(dy) > market.radius) {
+            spans.emplace_back(1, 0);
+            continue;
         }
-    } else {
-        entities.get<te::market>(market_e).population++;
-        return true;
+        const double half = std::sqrt(market.radius * market.radius - dy * dy);
+        const double middle = market_site.position.x - print.dimensions.x / 2.0f;
+        // rounding may be a cell out either way, so settle the ends by asking in_market
+        glm::ivec2 span {static_cast<int>(std::ceil(middle - half)) - 1, static_cast<int>(std::floor(middle + half)) + 1};
+        while (span.x <= span.y && !inside(span.x, y)) span.x++;
+        while (span.y >= span.x && !inside(span.y, y)) span.y--;
+        spans.push_back(span);
     }
+    const auto topleft = grid.pick_free(glm::ivec2{print.dimensions}, first_row, spans, rengine);
+    return topleft && try_place(dwelling_blueprint, centre_of(topleft->x, topleft->y));
 }
 
-int te::sim::market_stock(entt::entity market_e, entt::entity commodity_e) {
-    int tot = 0;
-    auto& market = entities.get<te::market>(market_e);
-    for (auto trader_e : market.trading) {
-        tot -= std::min(0.0, entities.get<te::trader>(trader_e).bid[commodity_e]);
+std::size_t te::sim::row_of(entt::entity market_e) {
+    if (auto found = entities.try_get<market_row>(market_e); found) {
+        return found->row;
     }
-    return tot;
+    const auto& market_prices = entities.get<te::market>(market_e).prices;
+    const auto row = markets.add_row(market_e, market_prices.size() == markets.columns ? market_prices : base_prices);
+    entities.emplace<market_row>(market_e, row);
+    return row;
+}
+
+int te::sim::market_stock(entt::entity market_e, commodity_slot commodity) {
+    const auto found = entities.try_get<market_row>(market_e);
+    if (!found) return 0;
+    return static_cast<int>(markets.asks[found->row * markets.columns + commodity]);
+}
+
+int te::sim::market_demand(entt::entity market_e, commodity_slot commodity) {
+    const auto found = entities.try_get<market_row>(market_e);
+    if (!found) return 0;
+    return static_cast<int>(markets.wanted[found->row * markets.columns + commodity] / 100.0);
+}
+
+void te::sim::list_trader(entt::entity market_e, entt::entity trader_e) {
+    auto& the_trader = entities.get<trader>(trader_e);
+    const auto row = row_of(market_e);
+    for (commodity_slot commodity = 0; commodity < the_trader.bid.size(); commodity++) {
+        markets.post(row, commodity, the_trader.bid[commodity], 1);
+    }
+    the_trader.listed_at = market_e;
+    entities.get<te::market>(market_e).trading.push_back(trader_e);
+}
+
+void te::sim::unlist_trader(trader& the_trader) {
+    // the market may have been destroyed already
+    if (auto listed = entities.try_get<market_row>(the_trader.listed_at); listed) {
+        for (commodity_slot commodity = 0; commodity < the_trader.bid.size(); commodity++) {
+            markets.post(listed->row, commodity, the_trader.bid[commodity], -1);
+        }
+    }
+    the_trader.listed_at = entt::null;
+}
+
+void te::sim::set_bid(trader& the_trader, commodity_slot commodity, double bid) {
+    if (auto listed = entities.try_get<market_row>(the_trader.listed_at); listed) {
+        markets.post(listed->row, commodity, the_trader.bid[commodity], -1);
+        markets.post(listed->row, commodity, bid, 1);
+    }
+    the_trader.bid[commodity] = bid;
+}
+
+void te::sim::on_market_row_destroyed(entt::registry&, entt::entity market_e) {
+    const auto moved = markets.remove_row(entities.get<market_row>(market_e).row);
+    if (moved != entt::null) {
+        entities.get<market_row>(moved).row = entities.get<market_row>(market_e).row;
+    }
+}
+
+void te::sim::on_market_replaced(entt::registry&, entt::entity market_e) {
+    // its trading list may have changed too
+    ledger_stale = true;
+    const auto found = entities.try_get<market_row>(market_e);
+    const auto& prices = entities.get<te::market>(market_e).prices;
+    if (!found || prices.size() != markets.columns) return;
+    std::copy(prices.begin(), prices.end(), markets.prices.begin() + found->row * markets.columns);
+}
+
+void te::sim::on_trader_replaced(entt::registry&, entt::entity) {
+    ledger_stale = true;
+}
+
+void te::sim::relist_all() {
+    std::fill(markets.asks.begin(), markets.asks.end(), 0.0);
+    std::fill(markets.wanted.begin(), markets.wanted.end(), 0.0);
+    auto traders = entities.view<trader>();
+    for (auto trader_e : traders) {
+        traders.get<trader>(trader_e).listed_at = entt::null;
+    }
+    for (auto market_e : entities.view<te::market, site>()) {
+        const auto row = row_of(market_e);
+        for (auto& trader_e : entities.get<te::market>(market_e).trading) {
+            auto the_trader = entities.try_get<trader>(trader_e);
+            // replicated lists can name traders that are gone; make those gaps for tick_merchants to close
+            if (!the_trader && trader_e != entt::null) {
+                trader_e = entt::null;
+                vacated_markets.push_back(market_e);
+            }
+            // gaps, and anything already listed elsewhere
+            if (!the_trader || the_trader->listed_at != entt::null) continue;
+            for (commodity_slot commodity = 0; commodity < the_trader->bid.size(); commodity++) {
+                markets.post(row, commodity, the_trader->bid[commodity], 1);
+            }
+            the_trader->listed_at = market_e;
+        }
+    }
+    ledger_stale = false;
+}
+
+void te::sim::leave_gap(entt::entity market_e, entt::entity trader_e) {
+    auto the_market = entities.try_get<te::market>(market_e);
+    if (!the_market) return;
+    if (auto slot = std::find(the_market->trading.begin(), the_market->trading.end(), trader_e); slot != the_market->trading.end()) {
+        *slot = entt::null;
+        vacated_markets.push_back(market_e);
+    }
+}
+
+void te::sim::on_trader_destroyed(entt::registry&, entt::entity trader_e) {
+    // merchants aren't members, so this is what takes one that's loading off the list
+    auto& the_trader = entities.get<trader>(trader_e);
+    leave_gap(the_trader.listed_at, trader_e);
+    unlist_trader(the_trader);
 }
 
 void te::sim::merchant_embark(entt::entity merchant_e, const te::route& route) {
-    entities.get<te::merchant>(merchant_e).route = route;
-    auto& bid = entities.get<te::trader>(merchant_e).bid;
-    bid.clear();
-    for (auto [commodity, leave_with] : route.stops[0].leave_with) {
-        bid[commodity] = static_cast<double>(leave_with);
+    auto& the_merchant = entities.get<te::merchant>(merchant_e);
+    if (the_merchant.state == merchant_state::loading) {
+        merchant_depart(merchant_e, the_merchant);
+    }
+    the_merchant.route = route;
+    the_merchant.next_stop_ix = 0;
+    the_merchant.state = merchant_state::en_route;
+    // find a way to the first stop from wherever it is
+    the_merchant.path.reset();
+    if (auto at = entities.try_get<site>(merchant_e); at) {
+        the_merchant.last_position = at->position;
     }
+    auto& the_trader = entities.get<te::trader>(merchant_e);
+    const auto& leave_with = route.stops[0].leave_with;
+    for (commodity_slot commodity = 0; commodity < leave_with.size(); commodity++) {
+        set_bid(the_trader, commodity, leave_with[commodity]);
+    }
+}
+
+std::shared_ptr<const te::path> te::sim::leg(entt::entity from_market, entt::entity to_market) {
+    const std::pair key {from_market, to_market};
+    if (auto cached = legs.find(key); cached != legs.end() && !cached->second->stale) {
+        return cached->second;
+    }
+    // a straight line is kept too, so an unreachable market isn't searched for at every
+    // departure; unblock_paths forgets it once there might be a way through
+    auto planned = plan_path(grid, entities.get<site>(from_market).position, entities.get<site>(to_market).position, from_market, to_market);
+    track_path(planned);
+    legs[key] = planned;
+    return planned;
+}
+
+void te::sim::track_path(const std::shared_ptr<path>& planned) {
+    // forget paths nobody's walking any more before we'd have to grow
+    if (paths.size() == paths.capacity()) {
+        std::erase_if(paths, [](const std::weak_ptr<path>& weak) { return weak.expired(); });
+    }
+    paths.push_back(planned);
+    straight_paths = straight_paths || planned->straight;
+}
+
+void te::sim::block_paths(glm::ivec2 topleft, glm::ivec2 dimensions) {
+    block_paths({{topleft, dimensions}});
+}
+
+void te::sim::block_paths(const std::vector<std::pair<glm::ivec2, glm::ivec2>>& footprints) {
+    if (footprints.empty()) return;
+    std::erase_if(paths, [&](const std::weak_ptr<path>& weak) {
+        auto walked = weak.lock();
+        if (!walked) return true;
+        const bool blocked = std::any_of(footprints.begin(), footprints.end(), [&](const auto& print) {
+            return walked->crosses(print.first, print.second);
+        });
+        if (blocked) {
+            walked->stale = true;
+            return true;
+        }
+        return false;
+    });
+    std::erase_if(legs, [](const auto& leg) { return leg.second->stale; });
+}
+
+void te::sim::unblock_paths() {
+    if (!straight_paths) return;
+    straight_paths = false;
+    std::erase_if(paths, [](const std::weak_ptr<path>& weak) {
+        auto walked = weak.lock();
+        if (!walked) return true;
+        if (walked->straight) {
+            walked->stale = true;
+            return true;
+        }
+        return false;
+    });
+    std::erase_if(legs, [](const auto& leg) { return leg.second->stale; });
+}
+
+void te::sim::set_out(merchant& the_merchant, std::shared_ptr<const path> walk) {
+    the_merchant.state = merchant_state::en_route;
+    the_merchant.segment = 0;
+    the_merchant.remaining = walk->lengths.front();
+    the_merchant.path = std::move(walk);
+}
+
+void te::sim::merchant_arrive(entt::entity merchant_e, merchant& the_merchant) {
+    auto& dest_market = entities.get<te::market>(the_merchant.route->stops[the_merchant.next_stop_ix].where);
+    the_merchant.state = merchant_state::loading;
+    the_merchant.trading_ix = dest_market.trading.size();
+    the_merchant.path.reset();
+    list_trader(the_merchant.route->stops[the_merchant.next_stop_ix].where, merchant_e);
+}
+
+void te::sim::merchant_depart(entt::entity merchant_e, merchant& the_merchant) {
+    const auto market_e = the_merchant.route->stops[the_merchant.next_stop_ix].where;
+    // leave a gap rather than shuffle everyone behind us forward; tick_merchants closes it
+    entities.get<te::market>(market_e).trading[the_merchant.trading_ix] = entt::null;
+    unlist_trader(entities.get<te::trader>(merchant_e));
+    vacated_markets.push_back(market_e);
+    the_merchant.state = merchant_state::en_route;
 }
 
 std::optional<te::merchant_activity> te::sim::merchant_status(entt::entity merchant_e) {
     auto& merchant = entities.get<te::merchant>(merchant_e);
     if (merchant.route) {
-        stop dest = merchant.route->stops[merchant.next_stop_ix];
-        auto& dest_market = entities.get<te::market>(dest.where);
-        auto it = std::find(dest_market.trading.begin(), dest_market.trading.end(), merchant_e);
-        if (it != dest_market.trading.end()) {
-            return te::merchant_activity{true, dest};
-        } else {
-            return te::merchant_activity{false, dest};
-        }
+        const stop& dest = merchant.route->stops[merchant.next_stop_ix];
+        return te::merchant_activity{merchant.state == merchant_state::loading, dest};
     } else {
         return std::nullopt;
     }
 }
 
 void te::sim::tick_merchants(double dt) {
-    auto merchants = entities.view<merchant, inventory, trader>();
+    auto merchants = entities.view<merchant, inventory, trader, site>();
     for (auto merchant_e : merchants) {
         auto& merchant = merchants.get<te::merchant>(merchant_e);
-        if (!merchant.route) continue;
-        te::stop& dest_stop = merchant.route->stops[merchant.next_stop_ix];
-        auto& dest_market = entities.get<te::market>(dest_stop.where);
-        auto dest = entities.get<te::site>(dest_stop.where);
-        auto market_it = std::find(dest_market.trading.begin(), dest_market.trading.end(), merchant_e);
-        if (market_it != dest_market.trading.end()) {
-            // inside the market
+        merchant.last_position = merchants.get<te::site>(merchant_e).position;
+        switch (merchant.state) {
+        case merchant_state::docked:
+            break;
+        case merchant_state::loading: {
+            const te::stop& dest_stop = merchant.route->stops[merchant.next_stop_ix];
             auto& merchant_inventory = merchants.get<te::inventory>(merchant_e);
+            // wait until it's satisfied
+            if (merchant_inventory.stock != dest_stop.leave_with) break;
+            merchant_depart(merchant_e, merchant);
+            merchants.get<te::site>(merchant_e).position = entities.get<te::site>(dest_stop.where).position;
+            merchant.next_stop_ix = (merchant.next_stop_ix + 1) % merchant.route->stops.size();
+            auto& next_stop = merchant.route->stops[merchant.next_stop_ix];
             auto& merchant_trader = merchants.get<te::trader>(merchant_e);
-            bool stop_satisfied = std::all_of (
-                commodities.begin(),
-                commodities.end(),
-                [&](entt::entity commodity) {
-                    return merchant_inventory.stock[commodity] == dest_stop.leave_with[commodity];
-                }
-            );
-            if (stop_satisfied) {
-                dest_market.trading.erase(market_it);
-                entities.emplace<te::site>(merchant_e, dest);
-                merchant.next_stop_ix = (merchant.next_stop_ix + 1) % merchant.route->stops.size();
-                auto& next_stop = merchant.route->stops[merchant.next_stop_ix];
-                auto& bids = merchant_trader.bid;
-                for (auto commodity_e : commodities) {
-                    bids[commodity_e] = next_stop.leave_with[commodity_e] - merchant_inventory.stock[commodity_e];
+            for (commodity_slot commodity = 0; commodity < merchant_trader.bid.size(); commodity++) {
+                set_bid(merchant_trader, commodity, next_stop.leave_with[commodity] - merchant_inventory.stock[commodity]);
+            }
+            set_out(merchant, leg(dest_stop.where, next_stop.where));
+            break;
+        }
+        case merchant_state::en_route: {
+            const te::stop& dest_stop = merchant.route->stops[merchant.next_stop_ix];
+            auto& merchant_site = merchants.get<te::site>(merchant_e);
+            if (!merchant.path || merchant.path->stale) {
+                // just embarked, or something's been built in the way
+                auto planned = plan_path(grid, merchant_site.position, entities.get<te::site>(dest_stop.where).position, entt::null, dest_stop.where);
+                track_path(planned);
+                set_out(merchant, std::move(planned));
+            }
+            const auto& walk = *merchant.path;
+            float step = static_cast<float>(dt);
+            while (step >= merchant.remaining && merchant.segment < walk.lengths.size()) {
+                step -= merchant.remaining;
+                if (++merchant.segment < walk.lengths.size()) {
+                    merchant_site.position = walk.waypoints[merchant.segment];
+                    merchant.remaining = walk.lengths[merchant.segment];
                 }
-            } else {
-                // wait until it's satisfied
             }
-        } else {
-            // en route
-            auto& merchant_site = entities.get<te::site>(merchant_e);
-            auto course = dest.position - merchant_site.position;
-            auto distance = glm::length(course);
-            if (distance <= 1.0) {
-                entities.remove<te::site>(merchant_e);
-                dest_market.trading.push_back(merchant_e);
+            if (merchant.segment == walk.lengths.size()) {
+                merchant_site.position = walk.waypoints.back();
+                merchant_arrive(merchant_e, merchant);
             } else {
-                merchant_site.position += glm::normalize(course) * static_cast<float>(dt);
+                merchant_site.position += walk.headings[merchant.segment] * step;
+                merchant.remaining -= step;
             }
+            break;
+        }
         }
     }
-}
 
-void te::sim::tick(double dt, bool quiet) {
-    tick_merchants(dt);
-    entities.view<market, site>().each (
-        [&](entt::entity market_e, auto& market, auto& market_site) {
-            // advance generators
-            entities.view<generator, inventory, trader, site>().each (
-                [&](auto& generator, auto& inventory, auto& trader, auto& generator_site) {
-                    if (in_market(generator_site, market_site, market)) {
-                        generator.active = true;
-                        if (generator.progress < 1.0) {
-                            generator.progress += generator.rate * dt;
-                        } else if (generator.progress >= 1.0 && inventory.stock[generator.output] < 10) {
-                            inventory.stock[generator.output]++;
-                            trader.bid[generator.output] -= 1.0;
-                            generator.progress -= 1.0;
-                        }
-                    } else {
-                        generator.active = false;
-                    }
-                }
-            );
+    // close the gaps departing merchants and destroyed members left, keeping everyone else in the order they arrived
+    std::sort(vacated_markets.begin(), vacated_markets.end());
+    vacated_markets.erase(std::unique(vacated_markets.begin(), vacated_markets.end()), vacated_markets.end());
+    for (auto market_e : vacated_markets) {
+        auto the_market = entities.try_get<te::market>(market_e);
+        if (!the_market) continue;
+        std::erase(the_market->trading, entt::entity{entt::null});
+        for (std::size_t ix = 0; ix < the_market->trading.size(); ix++) {
+            if (auto trading_merchant = entities.try_get<te::merchant>(the_market->trading[ix]); trading_merchant) {
+                trading_merchant->trading_ix = ix;
+            }
+        }
+    }
+    vacated_markets.clear();
+}
 
-            // advance producers
-            for (auto e : entities.view<producer, inventory, site, trader>()) {
-                auto& producer = entities.get<te::producer>(e);
-                auto& inventory = entities.get<te::inventory>(e);
-                auto& site = entities.get<te::site>(e);
-                auto& trader = entities.get<te::trader>(e);
-                if (in_market(site, market_site, market)) {
-                    if (producer.producing) {
-                        producer.progress += producer.rate * dt;
-                        if (producer.progress > 1.0) {
-                            for (auto [commodity, produced] : producer.outputs) {
-                                inventory.stock[commodity] += produced;
-                                trader.bid[commodity] -= produced;
-                            }
-                            producer.progress = 0.0;
-                            producer.producing = false;
-                        }
-                    } else {
-                        bool enough = std::all_of (
-                            producer.inputs.begin(),
-                            producer.inputs.end(),
-                            [&](auto pair) {
-                                auto [commodity, needed] = pair;
-                                return inventory.stock[commodity] >= needed;
-                            }
-                        );
-                        if (enough) {
-                            for (auto [commodity, needed] : producer.inputs) {
-                                inventory.stock[commodity] -= needed;
-                            }
-                            producer.producing = true;
-                        } else {
-                            for (auto [commodity, needed] : producer.inputs) {
-                                trader.bid[commodity] = std::max(0.0, needed - inventory.stock[commodity]);
-                            }
-                        }
-                    }
-                }
+void te::sim::tick_trades(entt::entity market_e, te::market& market, market_tick& outcome) {
+    auto& books = entities.get<te::order_books>(market_e).by_commodity;
+    auto& schedule = entities.get<production_schedule>(market_e);
+    // nobody has bid on anything else here
+    const auto& active = markets.active[entities.get<market_row>(market_e).row];
+    for (auto commodity : active) {
+        books[commodity].clear();
+    }
+    // traders that joined the market earlier get their orders filled first
+    for (std::size_t priority = 0; priority < market.trading.size(); priority++) {
+        const auto trader_e = market.trading[priority];
+        const auto& bid = entities.get<te::trader>(trader_e).bid;
+        const auto& stock = entities.get<te::inventory>(trader_e).stock;
+        for (auto commodity : active) {
+            if (bid[commodity] > 0.0) {
+                books[commodity].bid(trader_e, priority, bid[commodity]);
+            } else if (bid[commodity] < 0.0 && stock[commodity] > 0) {
+                books[commodity].ask(trader_e, priority, std::min(-bid[commodity], static_cast<double>(stock[commodity])));
             }
+        }
+    }
+    for (auto commodity : active) {
+        books[commodity].match([&](entt::entity buyer_e, entt::entity seller_e, int movement) {
+            const auto price = market.prices[commodity];
+            outcome.trades.push_back(trade_record {
+                market_e, buyer_e, seller_e, static_cast<std::uint32_t>(commodity), movement, price, ticks
+            });
+            auto& buyer = entities.get<te::trader>(buyer_e);
+            set_bid(buyer, commodity, buyer.bid[commodity] - movement);
+            entities.get<te::inventory>(buyer_e).stock[commodity] += movement;
+            buyer.balance -= price;
+            outcome.family_balance[buyer.family_ix] -= price;
+            auto& seller = entities.get<te::trader>(seller_e);
+            set_bid(seller, commodity, seller.bid[commodity] + movement);
+            entities.get<te::inventory>(seller_e).stock[commodity] -= movement;
+            seller.balance += price;
+            outcome.family_balance[seller.family_ix] += price;
+            wake(schedule, buyer_e);
+            wake(schedule, seller_e);
+        });
+    }
+}
 
-            // demanders cause the market trader to demand more
-            entities.view<demander, site>().each (
-                [&](auto& demander, auto& demander_site) {
-                    if (in_market(demander_site, market_site, market)) {
-                        for (auto [commodity_e, demand_rate] : demander.rate) {
-                            entities.get<trader>(market.commons).bid[commodity_e] += demand_rate * dt;
-                        }
-                    }
-                }
-            );
+void te::sim::schedule(production_schedule& schedule, entt::entity building, double due) {
+    if (due == never) return;
+    schedule.events.push_back(production_event{due, building});
+    std::push_heap(schedule.events.begin(), schedule.events.end(), std::greater<>{});
+}
 
-            // Do trades
-            for (auto commodity_e : commodities) {
-                // TODO: sort the traders somehow
-                // TODO: make this not O(N^2)
-                for (auto& trader_a_e : market.trading) {
-                    auto& a_stock = entities.get<te::inventory>(trader_a_e).stock[commodity_e];
-                    auto& a = entities.get<te::trader>(trader_a_e);
-                    auto& a_bid = a.bid[commodity_e];
-                    for (auto& trader_b_e : market.trading) {
-                        if (trader_a_e == trader_b_e) continue;
-                        auto& b_stock = entities.get<te::inventory>(trader_b_e).stock[commodity_e];
-                        auto& b = entities.get<te::trader>(trader_b_e);
-                        auto& b_bid = b.bid[commodity_e];
-                        // TODO: extract function for doing trades
-                        if (a_bid > 0.0 && b_bid < 0.0) {
-                            auto movement = static_cast<int>(std::min(a_bid, std::abs(b_bid)));
-                            if (movement != 0 && b_stock >= movement) {
-                                on_trade();
-                                auto price = market.prices[commodity_e];
-                                a_bid -= movement;
-                                a_stock += movement;
-                                a.balance -= price;
-                                families[a.family_ix].balance -= price;
-                                b_bid += movement;
-                                b_stock -= movement;
-                                b.balance += price;
-                                families[b.family_ix].balance += price;
-                            }
-                        }
-                    }
-                }
+void te::sim::schedule_generator(production_schedule& schedule, entt::entity building, generator& the_generator) {
+    the_generator.due = the_generator.rate > 0.0
+        ? now + std::max(0.0, 1.0 - the_generator.progress) / the_generator.rate
+        : never;
+    this->schedule(schedule, building, the_generator.due);
+}
+
+void te::sim::start_producer(production_schedule& schedule, entt::entity building) {
+    auto [the_producer, inventory, trader] = entities.get<producer, te::inventory, te::trader>(building);
+    bool enough = true;
+    for (commodity_slot commodity = 0; commodity < the_producer.inputs.size(); commodity++) {
+        enough &= inventory.stock[commodity] >= the_producer.inputs[commodity];
+    }
+    if (enough) {
+        for (commodity_slot commodity = 0; commodity < the_producer.inputs.size(); commodity++) {
+            inventory.stock[commodity] -= the_producer.inputs[commodity];
+        }
+        the_producer.producing = true;
+        the_producer.progress = 0.0;
+        the_producer.due = the_producer.rate > 0.0 ? now + 1.0 / the_producer.rate : never;
+        this->schedule(schedule, building, the_producer.due);
+    } else {
+        // wait for the inputs to be bought
+        for (commodity_slot commodity = 0; commodity < the_producer.inputs.size(); commodity++) {
+            if (the_producer.inputs[commodity] > 0.0) {
+                set_bid(trader, commodity, std::max(0.0, the_producer.inputs[commodity] - inventory.stock[commodity]));
             }
+        }
+        the_producer.due = never;
+    }
+}
 
-            // market demand is sum of all trader demands
-            market.demand = {};
-            for (auto trader_e : market.trading) {
-                const auto& trader = entities.get<te::trader>(trader_e);
-                for (auto [commodity, bid] : trader.bid) {
-                    market.demand[commodity] += std::max(0.0, std::floor(bid * (1.0 / 0.01)) / (1 / 0.01));
+void te::sim::wake(production_schedule& schedule, entt::entity building) {
+    if (auto the_generator = entities.try_get<generator>(building); the_generator && the_generator->active && the_generator->due == never) {
+        // it was full, and has just sold something
+        schedule_generator(schedule, building, *the_generator);
+    }
+    if (auto the_producer = entities.try_get<producer>(building); the_producer && !the_producer->producing && the_producer->due == never) {
+        // it may have just bought the last of its inputs
+        the_producer->due = now;
+        this->schedule(schedule, building, now);
+    }
+}
+
+void te::sim::run_production(entt::entity market_e) {
+    auto& schedule = entities.get<production_schedule>(market_e);
+    auto& events = schedule.events;
+    while (!events.empty() && events.front().due <= now) {
+        std::pop_heap(events.begin(), events.end(), std::greater<>{});
+        const auto [due, building] = events.back();
+        events.pop_back();
+        if (!entities.valid(building)) continue;
+        if (auto the_generator = entities.try_get<generator>(building); the_generator && the_generator->due == due) {
+            auto [inventory, trader] = entities.get<te::inventory, te::trader>(building);
+            if (inventory.stock[the_generator->output] < 10) {
+                inventory.stock[the_generator->output]++;
+                set_bid(trader, the_generator->output, trader.bid[the_generator->output] - 1.0);
+                the_generator->progress = 0.0;
+                schedule_generator(schedule, building, *the_generator);
+            } else {
+                // no room for it: hold on to the finished unit until something's sold
+                the_generator->progress = 1.0;
+                the_generator->due = never;
+            }
+        }
+        if (auto the_producer = entities.try_get<producer>(building); the_producer && the_producer->due == due) {
+            if (the_producer->producing) {
+                auto [inventory, trader] = entities.get<te::inventory, te::trader>(building);
+                for (commodity_slot commodity = 0; commodity < the_producer->outputs.size(); commodity++) {
+                    inventory.stock[commodity] += the_producer->outputs[commodity];
+                    set_bid(trader, commodity, trader.bid[commodity] - the_producer->outputs[commodity]);
                 }
+                the_producer->progress = 0.0;
+                the_producer->producing = false;
             }
+            start_producer(schedule, building);
+        }
+    }
+}
 
-            /* Calculate market prices
-             *   - prices should not increase unless there is at least 1 unit of demand */
-            for (auto& [commodity, price] : market.prices) {
-                const double base_price = entities.get<te::price>(commodity).price;
-                const double demand = market.demand[commodity];
-                const int stock = market_stock(market_e, commodity);
-                const double disparity = static_cast<int>(demand) - stock;
-                price = glm::clamp (
-                    price + disparity * 0.0002,
-                    base_price * 0.5,
-                    base_price * 1.5
-                );
+void te::sim::sync_progress() {
+    auto generators = entities.view<generator>();
+    for (auto e : generators) {
+        auto& the_generator = generators.get<generator>(e);
+        if (the_generator.due != never) {
+            the_generator.progress = std::clamp(1.0 - (the_generator.due - now) * the_generator.rate, 0.0, 1.0);
+        }
+    }
+    auto producers = entities.view<producer>();
+    for (auto e : producers) {
+        auto& the_producer = producers.get<producer>(e);
+        if (the_producer.producing && the_producer.due != never) {
+            the_producer.progress = std::clamp(1.0 - (the_producer.due - now) * the_producer.rate, 0.0, 1.0);
+        }
+    }
+}
+
+void te::sim::tick_market(entt::entity market_e, market_tick& outcome, double dt) {
+    auto& market = entities.get<te::market>(market_e);
+    outcome.family_balance.assign(families.size(), 0.0);
+    outcome.trades.clear();
+    outcome.profile = {};
+    auto lap_start = std::chrono::steady_clock::now();
+    const auto lap = [&](double tick_profile::* phase) {
+        if (!profile) return;
+        const auto now = std::chrono::steady_clock::now();
+        outcome.profile.*phase += std::chrono::duration<double>(now - lap_start).count();
+        lap_start = now;
+    };
+
+    // finish whatever's due
+    run_production(market_e);
+
+    lap(&tick_profile::production);
+
+    // demanders cause the market trader to demand more
+    auto& commons = entities.get<trader>(market.commons);
+    const auto& demand_rate = entities.get<market_members>(market_e).demand_rate;
+    if (!demand_rate.empty()) {
+        // anything demanded is active
+        for (auto commodity : markets.active[entities.get<market_row>(market_e).row]) {
+            set_bid(commons, commodity, commons.bid[commodity] + demand_rate[commodity] * dt);
+        }
+    }
+
+    lap(&tick_profile::demand);
+
+    tick_trades(market_e, market, outcome);
+    lap(&tick_profile::trades);
+}
+
+void te::sim::update_prices() {
+    const std::size_t columns = markets.columns;
+    const double* base = base_prices.data();
+    /* Calculate market prices
+     *   - prices should not increase unless there is at least 1 unit of demand */
+    for (std::size_t row = 0; row < markets.entities.size(); row++) {
+        double* prices = markets.prices.data() + row * columns;
+        const double* asks = markets.asks.data() + row * columns;
+        const double* wanted = markets.wanted.data() + row * columns;
+        const auto update = [&](std::size_t commodity) {
+            const double disparity = static_cast<int>(wanted[commodity] / 100.0) - asks[commodity];
+            prices[commodity] = glm::clamp (
+                prices[commodity] + disparity * 0.0002,
+                base[commodity] * 0.5,
+                base[commodity] * 1.5
+            );
+        };
+        // A row that's mostly active is cheaper to sweep whole, in a loop the compiler can
+        // vectorise; the inactive commodities have no bids or asks, so only get clamped.
+        if (markets.active[row].size() * 2 >= columns) {
+            for (std::size_t commodity = 0; commodity < columns; commodity++) {
+                update(commodity);
+            }
+        } else {
+            for (auto commodity : markets.active[row]) {
+                update(commodity);
             }
+        }
+    }
 
-            // calculate market population
-            market.population = 0;
-            auto dwellings = entities.view<dweller, site>();
-            for (auto entity : dwellings) {
-                auto& dwelling_site = dwellings.get<te::site>(entity);
-                if (in_market(dwelling_site, market_site, market)) {
-                    market.population++;
-                }
-            };
-
-            // calculate market growth rate
-            /*TODO: Need to get this figured out. The following should be taken into account:
-             *  - the price of basic goods
-             *  - how long dwellings have been without basic goods
-             *  - ???
-             */
-            // for now, let's say markets grow when both wheat and barley are reasonably priced
-            market.growth_rate = 0.0;
-            for (auto commodity : commodities) {
-                auto base_price = entities.get<price>(commodity).price;
-                market.growth_rate += ((base_price - market.prices[commodity]) / base_price) * 0.1;
+    // market demand is sum of all trader demands
+    for (std::size_t row = 0; row < markets.entities.size(); row++) {
+        auto& market = entities.get<te::market>(markets.entities[row]);
+        const double* prices = markets.prices.data() + row * columns;
+        const double* wanted = markets.wanted.data() + row * columns;
+        for (auto commodity : markets.active[row]) {
+            market.prices[commodity] = prices[commodity];
+            market.demand[commodity] = wanted[commodity] / 100.0;
+        }
+    }
+}
+
+void te::sim::update_growth(double dt) {
+    const std::size_t columns = markets.columns;
+    const double* base = base_prices.data();
+    // calculate market growth rate
+    /*TODO: Need to get this figured out. The following should be taken into account:
+     *  - the price of basic goods
+     *  - how long dwellings have been without basic goods
+     *  - ???
+     */
+    // for now, let's say markets grow when both wheat and barley are reasonably priced
+    for (std::size_t row = 0; row < markets.entities.size(); row++) {
+        const double* prices = markets.prices.data() + row * columns;
+        // inactive commodities are still at their base price, so add nothing
+        double growth_rate = 0.0;
+        for (auto commodity : markets.active[row]) {
+            growth_rate += ((base[commodity] - prices[commodity]) / base[commodity]) * 0.1;
+        }
+        auto& market = entities.get<te::market>(markets.entities[row]);
+        market.growth_rate = glm::clamp(growth_rate, -(1.0 / 3.0), 1.0 / 4.0);
+
+        // grow
+        market.growth += market.growth_rate * dt;
+    }
+}
+
+void te::sim::tick(double dt, bool quiet) {
+    auto lap_start = std::chrono::steady_clock::now();
+    const auto lap = [&](double tick_profile::* phase) {
+        if (!profile) return;
+        const auto now = std::chrono::steady_clock::now();
+        (*profile).*phase += std::chrono::duration<double>(now - lap_start).count();
+        lap_start = now;
+    };
+
+    now += dt;
+    ticks++;
+    if (ledger_stale) relist_all();
+    tick_merchants(dt);
+    lap(&tick_profile::merchants);
+
+    // Markets may be ticked in parallel, so nothing may be emplaced while they are:
+    // give each market its bookkeeping components first.
+    ticking_markets.clear();
+    for (auto market_e : entities.view<market, site>()) {
+        // markets replicated to a client arrive without a row
+        row_of(market_e);
+        entities.get_or_emplace<market_members>(market_e);
+        entities.get_or_emplace<order_books>(market_e).by_commodity.resize(commodities.size());
+        entities.get_or_emplace<production_schedule>(market_e);
+        entities.get_or_emplace<market_history>(market_e).by_commodity.resize(commodities.size());
+        ticking_markets.push_back(market_e);
+    }
+    market_ticks.resize(ticking_markets.size());
+    const auto tick_ix = [&](std::size_t ix) {
+        tick_market(ticking_markets[ix], market_ticks[ix], dt);
+    };
+    if (pool) {
+        pool->parallel_for(ticking_markets.size(), tick_ix);
+    } else {
+        for (std::size_t ix = 0; ix < ticking_markets.size(); ix++) tick_ix(ix);
+    }
+    lap(&tick_profile::markets);
+
+    update_prices();
+    lap(&tick_profile::prices);
+    update_growth(dt);
+    lap(&tick_profile::growth);
+
+    // apply what each market did to the rest of the world, always in the same order
+    for (std::size_t ix = 0; ix < ticking_markets.size(); ix++) {
+        const auto market_e = ticking_markets[ix];
+        const auto& outcome = market_ticks[ix];
+        for (std::size_t family_ix = 0; family_ix < families.size(); family_ix++) {
+            families[family_ix].balance += outcome.family_balance[family_ix];
+        }
+        for (const auto& trade : outcome.trades) {
+            trade_log.push(trade);
+        }
+        record_history(market_e, outcome);
+        if (profile) *profile += outcome.profile;
+
+        // queue markets with whole dwellings to create or destroy
+        const auto& market = entities.get<te::market>(market_e);
+        if (static_cast<int>(market.growth) != 0) {
+            if (auto queued = entities.try_get<growth_queued>(market_e); !queued) {
+                entities.emplace<growth_queued>(market_e);
+                growing_markets.push_back(market_e);
+            } else if (queued->retry_at && now >= *queued->retry_at) {
+                queued->retry_at.reset();
+                growing_markets.push_back(market_e);
             }
-            market.growth_rate = glm::clamp(market.growth_rate, -(1.0 / 3.0), 1.0 / 4.0);
+        }
+    }
+    apply_growth();
+    lap(&tick_profile::apply);
+}
 
-            // grow
-            market.growth += market.growth_rate * dt;
+void te::sim::record_history(entt::entity market_e, const market_tick& outcome) {
+    traded.resize(commodities.size(), 0.0);
+    for (const auto& trade : outcome.trades) {
+        traded[trade.commodity] += trade.quantity;
+    }
+    auto& history = entities.get<market_history>(market_e);
+    const auto row = entities.get<market_row>(market_e).row;
+    const std::size_t first = row * markets.columns;
+    for (auto commodity : markets.active[row]) {
+        history.record(commodity, market_sample {
+            now,
+            static_cast<float>(markets.prices[first + commodity]),
+            static_cast<float>(traded[commodity]),
+            static_cast<float>(markets.asks[first + commodity]),
+            static_cast<float>(markets.wanted[first + commodity] / 100.0)
+        });
+        traded[commodity] = 0.0;
+    }
+}
 
-            // create/destroy dwellings
-            while (static_cast<int>(market.growth) > 0 && spawn_dwelling(market_e)) {
+void te::sim::apply_growth() {
+    // Markets take turns, one dwelling at a time, until the budget is spent; any
+    // still owed go to the back of the queue and carry on next tick
+    for (int budget = growth_budget; budget > 0 && !growing_markets.empty(); budget--) {
+        const auto market_e = growing_markets.front();
+        growing_markets.pop_front();
+        if (!entities.valid(market_e) || !entities.all_of<te::market>(market_e)) continue;
+        auto& market = entities.get<te::market>(market_e);
+        if (static_cast<int>(market.growth) > 0) {
+            if (spawn_dwelling(market_e)) {
                 market.growth -= 1.0;
+            } else {
+                // no room: stay off the queue for a while rather than search again every tick
+                entities.get<growth_queued>(market_e).retry_at = now + growth_backoff;
+                continue;
             }
-            while (static_cast<int>(market.growth) < 0) {
-                market.growth += 1.0;
-                for (auto dwelling : entities.view<dweller, site>()) {
-                    auto& dwelling_site = entities.get<site>(dwelling);
-                    if (in_market(dwelling_site, market_site, market)) {
-                        entities.destroy(dwelling);
-                        break;
-                    }
-                }
+        } else if (static_cast<int>(market.growth) < 0) {
+            market.growth += 1.0;
+            const auto& dwellings = entities.get<market_members>(market_e).dwellings;
+            if (!dwellings.empty()) {
+                demolish(dwellings.back());
             }
         }
-    );
+        if (static_cast<int>(market.growth) != 0) {
+            growing_markets.push_back(market_e);
+        } else {
+            entities.remove<growth_queued>(market_e);
+        }
+    }
 }
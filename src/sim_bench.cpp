@@ -0,0 +1,116 @@
+// Headless benchmark of te::sim. Run from the repository root (the sim loads
+// assets/commodities.csv) as `sim_bench [ticks] [threads]`; threads = 0 ticks
+// markets serially. Prints one CSV row per generated world.
+#include <te/sim.hpp>
+#include <te/thread_pool.hpp>
+#include <fmt/format.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    struct scenario {
+        int buildings;
+        int markets;
+    };
+
+    // Markets must be further apart than the sum of their radii
+    const int market_pitch = 12;
+    // Room for a 2x2 building plus a gap
+    const int building_pitch = 3;
+
+    int map_side(const scenario& world) {
+        const int for_markets = static_cast<int>(std::ceil(std::sqrt(world.markets))) * market_pitch;
+        // leave half the building lattice empty so dwellings have room to grow
+        const int for_buildings = static_cast<int>(std::ceil(std::sqrt(world.buildings * 2.0))) * building_pitch;
+        const int side = std::max({40, for_markets, for_buildings});
+        return side + side % 2;
+    }
+
+    // Places markets and buildings on fixed lattices rather than by sim::spawn,
+    // so generating a crowded world never has to retry a placement.
+    void generate(te::sim& model, const scenario& world) {
+        const int side = model.map_width;
+        const glm::vec2 map_topleft {-side / 2.0f, -side / 2.0f};
+        const auto market_blueprint = model.blueprints[3];
+        const int markets_across = std::max(1, side / market_pitch);
+        for (int i = 0; i < world.markets; i++) {
+            const glm::vec2 topleft = map_topleft + glm::vec2 {
+                (i % markets_across) * market_pitch + market_pitch / 2,
+                (i / markets_across) * market_pitch + market_pitch / 2
+            };
+            model.try_place(market_blueprint, topleft + model.entities.get<te::footprint>(market_blueprint).dimensions / 2.0f);
+        }
+
+        std::vector<glm::vec2> lattice;
+        for (int x = 0; x + 2 <= side; x += building_pitch) {
+            for (int y = 0; y + 2 <= side; y += building_pitch) {
+                lattice.push_back(map_topleft + glm::vec2{x, y});
+            }
+        }
+        std::shuffle(lattice.begin(), lattice.end(), model.rengine);
+        std::discrete_distribution<std::size_t> select_blueprint {7, 7, 2, 0, 2};
+        // some lattice points are under markets, so keep going until enough have been placed
+        int placed = 0;
+        auto next = lattice.begin();
+        while (placed < world.buildings && next != lattice.end()) {
+            std::vector<std::vector<glm::vec2>> centres(model.blueprints.size());
+            for (int wanted = world.buildings - placed; wanted > 0 && next != lattice.end(); wanted--, next++) {
+                const auto blueprint_ix = select_blueprint(model.rengine);
+                const auto& print = model.entities.get<te::footprint>(model.blueprints[blueprint_ix]);
+                centres[blueprint_ix].push_back(*next + print.dimensions / 2.0f);
+            }
+            for (std::size_t blueprint_ix = 0; blueprint_ix < centres.size(); blueprint_ix++) {
+                placed += model.spawn_many(model.blueprints[blueprint_ix], centres[blueprint_ix]).size();
+            }
+        }
+    }
+}
+
+int main(const int argc, const char** argv) {
+    const int ticks = argc > 1 ? std::stoi(argv[1]) : 100;
+    const unsigned threads = argc > 2 ? std::stoul(argv[2]) : std::thread::hardware_concurrency();
+    const double dt = 0.5;
+
+    std::unique_ptr<te::thread_pool> pool;
+    if (threads > 0) {
+        pool = std::make_unique<te::thread_pool>(threads);
+    }
+
+    fmt::print("buildings,markets,map_side,threads,ticks,seconds,ticks_per_second,"
+               "merchants_ms,markets_ms,production_ms,demand_ms,trades_ms,prices_ms,growth_ms,apply_ms\n");
+    for (int buildings : {40, 400, 4000, 40000, 100000}) {
+        for (int markets : {1, 10, 100, 1000}) {
+            if (markets > buildings) continue;
+            const scenario world { buildings, markets };
+            const int side = map_side(world);
+            te::sim model { 44, side, side };
+            model.pool = pool.get();
+            generate(model, world);
+
+            // let prices and bids settle before measuring
+            model.tick(dt);
+            model.profile.emplace();
+            const auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < ticks; i++) {
+                model.tick(dt);
+            }
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            const auto& p = *model.profile;
+            const auto per_tick_ms = [&](double seconds) { return seconds * 1000.0 / ticks; };
+            fmt::print (
+                "{},{},{},{},{},{:.6f},{:.2f},{:.4f},{:.4f},{:.4f},{:.4f},{:.4f},{:.4f},{:.4f},{:.4f}\n",
+                buildings, markets, side, threads, ticks, elapsed.count(), ticks / elapsed.count(),
+                per_tick_ms(p.merchants), per_tick_ms(p.markets), per_tick_ms(p.production),
+                per_tick_ms(p.demand), per_tick_ms(p.trades),
+                per_tick_ms(p.prices), per_tick_ms(p.growth), per_tick_ms(p.apply)
+            );
+        }
+    }
+}
@@ -129,7 +129,8 @@ te::text_run te::canvas_renderer::shape_run(std::string_view str, font fspec) {
     hb_glyph_info_t* info = hb_buffer_get_glyph_infos (shaping_buffer.hnd.get(), nullptr);
     hb_glyph_position_t* pos = hb_buffer_get_glyph_positions (shaping_buffer.hnd.get(), nullptr);
 
-    std::vector<te::text_run::glyph_instance> glyphs;
+    std::pmr::vector<te::text_run::glyph_instance> glyphs { &frame_arena };
+    glyphs.reserve(len);
     glm::vec2 cursor;
     for (unsigned int i = 0; i < len; i++) {
         ft::glyph_index gix { info[i].codepoint };
@@ -149,14 +150,14 @@ te::text_run te::canvas_renderer::shape_run(std::string_view str, font fspec) {
         cursor.y += pos[i].y_advance / 64.0;
     }
     return te::text_run {
-        .glyphs = glyphs,
+        .glyphs = std::move(glyphs),
         .total_width = cursor.x,
-        .fnt = fspec
+        .fnt = std::move(fspec)
     };
 }
 
-void te::canvas_renderer::run(te::text_run run, glm::vec2 origin) {
-    for (auto glyph : run.glyphs) {
+void te::canvas_renderer::run(const te::text_run& run, glm::vec2 origin) {
+    for (const auto& glyph : run.glyphs) {
         image (*glyph.texture, origin + glyph.offset, run.fnt.colour);
     }
 }
@@ -184,5 +185,6 @@ void te::canvas_renderer::render() {
     }
     quads.clear();
     textures.clear();
+    frame_arena.reset();
 }
 
@@ -36,12 +36,11 @@ te::ui::paragraph te::ui::root::make_paragraph(text_align align, double width_av
     design_height *= fnt.line_height;
 
     auto space_width = canvas.shape_run(" ", fnt).total_width;
-    std::vector<text_run> words;
+    std::pmr::vector<text_run> words { &canvas.frame_arena };
     auto word_begin = text.begin();
     auto word_end = std::find(text.begin(), text.end(), ' ');
     while (word_begin != text.end()) {
         words.push_back(canvas.shape_run({std::to_address(word_begin), std::to_address(word_end)}, fnt));
-        std::string werd {word_begin, word_end};
         if (word_end == text.end()) {
             break;
         } else {
@@ -51,21 +50,23 @@ te::ui::paragraph te::ui::root::make_paragraph(text_align align, double width_av
         }
     }
     glm::vec2 cursor {0, 0};
-    std::vector<offset_run> runs;
-    for (auto word : words) {
-        if (cursor.x + word.total_width >= width_avail) {
+    std::pmr::vector<offset_run> runs { &canvas.frame_arena };
+    runs.reserve(words.size());
+    for (auto& word : words) {
+        const double word_width = word.total_width;
+        if (cursor.x + word_width >= width_avail) {
             cursor.x = 0;
             cursor.y += design_height * line_height;
         }
         runs.push_back (
             offset_run {
                 .offset = cursor,
-                .run = word
+                .run = std::move(word)
             }
         );
-        cursor.x += word.total_width + space_width;
+        cursor.x += word_width + space_width;
     }
-    return paragraph { runs };
+    return paragraph { std::move(runs) };
 }
 
 te::ui::root::root(te::window& win, te::canvas_renderer& canvas, te::cache<asset_loader>& loader):
@@ -454,13 +455,13 @@ te::ui::generator_window::generator_window(sim& model, root& ui, entt::entity e)
     out_icon->parent = this;
     out_icon->offset = {39.0f, 86.0f};
     out_icon->size = {21.0f, 21.0f};
-    out_icon->bg_image = model.entities.get<render_tex>(gen.output).filename;
+    out_icon->bg_image = model.entities.get<render_tex>(model.commodities[gen.output]).filename;
 
     auto out_label = this->children.emplace_back(std::make_shared<ui::node>());
     out_label->parent = this;
     out_label->offset = {70.0f, 91.0f};
     out_label->size = {154.0f, 14.0f};
-    out_label->text(model.entities.get<named>(gen.output).name);
+    out_label->text(model.entities.get<named>(model.commodities[gen.output]).name);
     out_label->font_ = font {
         .filename = "Alegreya_Sans_SC/AlegreyaSansSC-Medium.ttf",
         .pts = 7.5,
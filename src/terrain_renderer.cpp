@@ -1,9 +1,18 @@
 #include <te/terrain_renderer.hpp>
+#include <te/occupancy_grid.hpp>
 #include <te/util.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cmath>
+#include <optional>
 
 namespace {
+    // tiles along each side of a terrain chunk, matching the sim's world chunks
+    const int chunk_side = te::occupancy_grid::chunk_side;
+
+    // Vertices for a width x height patch of randomly chosen tiles, with its top left at the origin
     te::gl::buffer<GL_ARRAY_BUFFER> fill_grid(te::gl::context& gl, std::default_random_engine& rengine, int width, int height) {
         static std::uniform_int_distribution tile_select {0, 3};
         struct vertex {
@@ -14,13 +23,12 @@ namespace {
         static_assert(sizeof(vertex) == sizeof(GLfloat) * 7, "Platform doesn't support this directly.");
         std::vector<vertex> data;
         data.reserve(width * height * 6);
-        glm::vec2 grid_tl {-width/2.0f, -height/2.0f};
         glm::vec3 white {1.0f, 1.0f, 1.0f};
         for (int xi = 0; xi < width; xi++) {
             for (int yi = 0; yi < height; yi++) {
                 glm::vec2 uv_tl {tile_select(rengine) * 0.25f, tile_select(rengine) * 0.25f};
-                auto cell_tl_pos = grid_tl + static_cast<float>(xi) * glm::vec2{1.0f, 0.0f}
-                                           + static_cast<float>(yi) * glm::vec2{0.0f, 1.0f};
+                auto cell_tl_pos = static_cast<float>(xi) * glm::vec2{1.0f, 0.0f}
+                                 + static_cast<float>(yi) * glm::vec2{0.0f, 1.0f};
                 vertex cell_tl {cell_tl_pos + glm::vec2{0.0f, 0.0f}, white, uv_tl + glm::vec2(0.0f, 0.0f)};
                 vertex cell_tr {cell_tl_pos + glm::vec2{1.0f, 0.0f}, white, uv_tl + glm::vec2(0.5f, 0.0f)};
                 vertex cell_br {cell_tl_pos + glm::vec2{1.0f, 1.0f}, white, uv_tl + glm::vec2(0.5f, 0.5f)};
@@ -35,11 +43,18 @@ namespace {
         }
         return gl.make_buffer<GL_ARRAY_BUFFER>(data.begin(), data.end());
     }
+
+    // Where the ray through a point on the screen meets the ground, if it does
+    std::optional<glm::vec2> ground_under(const te::camera& cam, glm::vec2 ndc) {
+        const auto [origin, direction] = cam.cast({ndc.x, ndc.y, 1.0f});
+        if (direction.z >= 0.0f) return std::nullopt;
+        const glm::vec3 hit = origin + direction * (-origin.z / direction.z);
+        return glm::vec2{hit.x, hit.y};
+    }
 }
 
 te::terrain_renderer::terrain_renderer(gl::context& ogl, std::default_random_engine& rengine, int width, int height):
     gl(ogl),
-    vbo(fill_grid(gl, rengine, width, height)),
     program(gl.link(gl.compile(te::file_contents("shaders/terrain_vertex.glsl"), GL_VERTEX_SHADER),
                     gl.compile(te::file_contents("shaders/terrain_fragment.glsl"), GL_FRAGMENT_SHADER)).hnd),
     model_uniform(program.uniform("model")),
@@ -49,32 +64,84 @@ te::terrain_renderer::terrain_renderer(gl::context& ogl, std::default_random_eng
     texture(gl.make_texture("assets/tiles.png")),
     width(width),
     height(height),
-    grid_topleft{-width/2.0f, -height/2.0f, 0.0f}
+    grid_topleft{-width/2, -height/2, 0.0f}
 {
     glUseProgram(*program.hnd);
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
     GLint pos_attrib = program.find_attribute("position").value();
-    glEnableVertexAttribArray(pos_attrib);
-    glVertexAttribPointer(pos_attrib, 2, GL_FLOAT, GL_FALSE, 7*sizeof(float), reinterpret_cast<void*>(0));
     GLint col_attrib = program.find_attribute("colour").value();
-    glEnableVertexAttribArray(col_attrib);
-    glVertexAttribPointer(col_attrib, 3, GL_FLOAT, GL_FALSE, 7*sizeof(float), reinterpret_cast<void*>(2*sizeof(float)));
     GLint tex_attrib = program.find_attribute("texcoord").value();
-    glEnableVertexAttribArray(tex_attrib);
-    glVertexAttribPointer(tex_attrib, 2, GL_FLOAT, GL_FALSE, 7*sizeof(float), reinterpret_cast<void*>(5*sizeof(float)));
+    // chunks along the right and bottom edges are cut short when the map isn't a whole number of chunks
+    const int widths[] = {std::min(width, chunk_side), width % chunk_side};
+    const int heights[] = {std::min(height, chunk_side), height % chunk_side};
+    for (int mesh_width : widths) {
+        for (int mesh_height : heights) {
+            if (mesh_width == 0 || mesh_height == 0) continue;
+            for (int variant = 0; variant < variants; variant++) {
+                if (std::any_of(meshes.begin(), meshes.end(), [&](const chunk_mesh& m) {
+                    return m.width == mesh_width && m.height == mesh_height && m.variant == variant;
+                })) continue;
+                auto& mesh = meshes.emplace_back(chunk_mesh{mesh_width, mesh_height, variant, fill_grid(gl, rengine, mesh_width, mesh_height), 0});
+                glGenVertexArrays(1, &mesh.vao);
+                glBindVertexArray(mesh.vao);
+                mesh.vbo.bind();
+                glEnableVertexAttribArray(pos_attrib);
+                glVertexAttribPointer(pos_attrib, 2, GL_FLOAT, GL_FALSE, 7*sizeof(float), reinterpret_cast<void*>(0));
+                glEnableVertexAttribArray(col_attrib);
+                glVertexAttribPointer(col_attrib, 3, GL_FLOAT, GL_FALSE, 7*sizeof(float), reinterpret_cast<void*>(2*sizeof(float)));
+                glEnableVertexAttribArray(tex_attrib);
+                glVertexAttribPointer(tex_attrib, 2, GL_FLOAT, GL_FALSE, 7*sizeof(float), reinterpret_cast<void*>(5*sizeof(float)));
+            }
+        }
+    }
+}
+
+const te::terrain_renderer::chunk_mesh& te::terrain_renderer::mesh_for(int chunk_x, int chunk_y) const {
+    const int mesh_width = std::min(chunk_side, width - chunk_x * chunk_side);
+    const int mesh_height = std::min(chunk_side, height - chunk_y * chunk_side);
+    // scatter the variants so the repeats aren't obvious
+    const int variant = static_cast<unsigned>(chunk_x * 7919 + chunk_y * 104729) % variants;
+    return *std::find_if(meshes.begin(), meshes.end(), [&](const chunk_mesh& m) {
+        return m.width == mesh_width && m.height == mesh_height && m.variant == variant;
+    });
 }
 
 void te::terrain_renderer::render(const te::camera& cam) {
     glUseProgram(*program.hnd);
-    glm::mat4 model { 1 };
-    glUniformMatrix4fv(model_uniform, 1, GL_FALSE, glm::value_ptr(model));
     glUniformMatrix4fv(view_uniform, 1, GL_FALSE, glm::value_ptr(cam.view()));
     glUniformMatrix4fv(proj_uniform, 1, GL_FALSE, glm::value_ptr(cam.projection()));
-    glBindVertexArray(vao);
 
     sampler.bind(0);
     texture.activate(0);
-    
-    glDrawArrays(GL_TRIANGLES, 0, width * height * 6);
+
+    // find the chunks under the screen; if the view reaches the horizon just draw them all
+    const int chunks_across = (width + chunk_side - 1) / chunk_side;
+    const int chunks_down = (height + chunk_side - 1) / chunk_side;
+    glm::ivec2 first_chunk {0, 0};
+    glm::ivec2 last_chunk {chunks_across - 1, chunks_down - 1};
+    const auto corners = {
+        ground_under(cam, {-1.0f, -1.0f}), ground_under(cam, {1.0f, -1.0f}),
+        ground_under(cam, {-1.0f,  1.0f}), ground_under(cam, {1.0f,  1.0f})
+    };
+    if (std::all_of(corners.begin(), corners.end(), [](const auto& c) { return c.has_value(); })) {
+        glm::vec2 lo = **corners.begin();
+        glm::vec2 hi = lo;
+        for (const auto& corner : corners) {
+            lo = glm::min(lo, *corner);
+            hi = glm::max(hi, *corner);
+        }
+        const glm::vec2 topleft {grid_topleft.x, grid_topleft.y};
+        first_chunk = glm::max(first_chunk, glm::ivec2{glm::floor((lo - topleft) / static_cast<float>(chunk_side))});
+        last_chunk = glm::min(last_chunk, glm::ivec2{glm::floor((hi - topleft) / static_cast<float>(chunk_side))});
+    }
+
+    for (int cy = first_chunk.y; cy <= last_chunk.y; cy++) {
+        for (int cx = first_chunk.x; cx <= last_chunk.x; cx++) {
+            const auto& mesh = mesh_for(cx, cy);
+            const glm::vec3 offset = grid_topleft + glm::vec3{cx * chunk_side, cy * chunk_side, 0.0f};
+            const glm::mat4 model = glm::translate(glm::mat4{1}, offset);
+            glUniformMatrix4fv(model_uniform, 1, GL_FALSE, glm::value_ptr(model));
+            glBindVertexArray(mesh.vao);
+            glDrawArrays(GL_TRIANGLES, 0, mesh.width * mesh.height * 6);
+        }
+    }
 }
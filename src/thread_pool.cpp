@@ -0,0 +1,83 @@
+#include <te/thread_pool.hpp>
+#include <cassert>
+
+te::thread_pool::thread_pool(unsigned threads) {
+    threads = std::max(1u, threads);
+    for (unsigned i = 0; i < threads; i++) {
+        queues.push_back(std::make_unique<queue>());
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        workers.emplace_back([this, i] { work(i); });
+    }
+}
+
+te::thread_pool::~thread_pool() {
+    {
+        std::lock_guard lock { sleep_mutex };
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+std::size_t te::thread_pool::size() const {
+    return queues.size();
+}
+
+void te::thread_pool::submit(std::function<void()> task) {
+    auto& target = *queues[next_queue++ % queues.size()];
+    {
+        // counted under the queue's lock, so nobody can take the task before it's counted
+        std::lock_guard lock { target.mutex };
+        target.tasks.push_back(std::move(task));
+        queued.fetch_add(1);
+    }
+    // a worker checking for tasks has either seen the count or is waiting to be woken
+    {
+        std::lock_guard lock { sleep_mutex };
+    }
+    wake.notify_one();
+}
+
+void te::thread_pool::uncount() {
+    [[maybe_unused]] const auto before = queued.fetch_sub(1);
+    assert(before > 0 && "took more tasks than were queued");
+}
+
+std::optional<std::function<void()>> te::thread_pool::take(std::size_t home) {
+    {
+        auto& own = *queues[home];
+        std::lock_guard lock { own.mutex };
+        if (!own.tasks.empty()) {
+            auto task = std::move(own.tasks.front());
+            own.tasks.pop_front();
+            uncount();
+            return task;
+        }
+    }
+    for (std::size_t offset = 1; offset < queues.size(); offset++) {
+        auto& victim = *queues[(home + offset) % queues.size()];
+        std::lock_guard lock { victim.mutex };
+        if (!victim.tasks.empty()) {
+            auto task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+            uncount();
+            return task;
+        }
+    }
+    return std::nullopt;
+}
+
+void te::thread_pool::work(std::size_t home) {
+    while (true) {
+        if (auto task = take(home); task) {
+            (*task)();
+            continue;
+        }
+        std::unique_lock lock { sleep_mutex };
+        wake.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0) return;
+    }
+}